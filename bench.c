@@ -0,0 +1,204 @@
+/* Clocks are a POSIX matter. */
+#define _POSIX_C_SOURCE 200112L
+
+#include <time.h>
+
+#include "reqsim.h"
+
+/* This is a benchmark of the library: a few fixed workloads, large enough
+ * to time, are planned with planraidreq, and the stripe requests planned
+ * per second and the nanoseconds spent on each are printed, one line per
+ * workload and kernel. Each workload is planned by the generic kernel and
+ * by the kernel for its geometry, which is the generic one unless
+ * GEOMETRIES (see Makefile) names it, and the speedup of the latter is
+ * given. Requests are made up before the clock starts, from a fixed seed,
+ * so every run plans the same ones. Before any timing, every request is
+ * planned by both kernels, which must agree stripe request by stripe
+ * request; this also warms up the caches and the branch predictors. Each
+ * kernel is then timed RUNS times, taking turns with the other, and the
+ * best run counts. "make bench" builds the library along with this file,
+ * at the same flags, runs it and keeps the results in benchresults.txt. */
+
+/* Requests per workload, and timed runs per kernel. */
+#define REQS (1UL << 20)
+#define RUNS 5
+
+struct workload {
+    const char *name;
+    struct dskarray array;
+    enum reqnature nature;
+    unsigned len;    /* Of every request. */
+    int sequential;  /* Otherwise, offsets are random. */
+};
+
+static const struct workload workloads[] = {
+    /* Long sequential writes: 1 MiB at a time, across full stripes. */
+    {"seqwrite", {RAID5, 8, 65536, FLTFREE}, WRITEREQ, 1 << 20, 1},
+    /* Random 4 KiB writes, read-modify-write territory. */
+    {"randwrite4k", {RAID5, 4, 65536, FLTFREE}, WRITEREQ, 4096, 0},
+    /* Random 16 KiB reads with a disk gone. */
+    {"degradedread", {RAID5, 4, 65536, 2}, READREQ, 16384, 0}
+};
+
+/* The range requests fall in: 1 GiB. */
+#define SPAN (1UL << 30)
+
+static unsigned long seed;
+
+/* A linear congruential generator, so that runs do not depend on rand. */
+static unsigned long nextrandom()
+{
+    seed = (seed * 1103515245UL + 12345) & 0x7fffffffUL;
+
+    return seed;
+}
+
+static double now()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* This function plans a request of a workload, or exits. */
+static void plan1(const struct workload *wl, const struct raidreq *req,
+  struct ioplan *plan)
+{
+    if (planraidreq(&wl->array, req, plan)) {
+        fprintf(stderr, "Could not plan a request of %s.\n", wl->name);
+        exit(35);
+    }
+}
+
+/* This function tells whether two scopes are the same. */
+static int samescope(const struct unitscope *a, const struct unitscope *b)
+{
+    return a->offset == b->offset && a->len == b->len;
+}
+
+/* This function plans every request with the generic kernel and with the
+ * kernel for the geometry, and exits unless the two plan the same stripe
+ * requests, by the same methods, with the same scopes. */
+static void agree(const struct workload *wl, const struct raidreq *reqs,
+  struct ioplan *generic, struct ioplan *special)
+{
+    unsigned disk, i, n;
+    const struct stripeplan *a, *b;
+
+    generic->generic = 1;
+    special->generic = 0;
+
+    for (i = 0; i < REQS; ++i) {
+        plan1(wl, &reqs[i], generic);
+        plan1(wl, &reqs[i], special);
+
+        if (generic->sreqcount != special->sreqcount) break;
+
+        for (n = 0; n < generic->sreqcount; ++n) {
+            a = &generic->sreqs[n];
+            b = &special->sreqs[n];
+            if (a->offset != b->offset || a->len != b->len || a->stripe !=
+              b->stripe || a->method != b->method)
+                break;
+            for (disk = 0; disk <= wl->array.datadsks; ++disk)
+                if (!samescope(&a->rd[disk], &b->rd[disk]) ||
+                  !samescope(&a->wr[disk], &b->wr[disk]))
+                    break;
+            if (disk <= wl->array.datadsks) break;
+        }
+        if (n < generic->sreqcount) break;
+    }
+
+    if (i < REQS) {
+        fprintf(stderr, "The kernels plan request %u of %s differently.\n",
+          i, wl->name);
+        exit(40);
+    }
+}
+
+/* This function plans the requests with the plan, one after another, and
+ * returns the time taken. */
+static double run(const struct workload *wl, const struct raidreq *reqs,
+  struct ioplan *plan, unsigned long *sreqs)
+{
+    unsigned i;
+    double start;
+
+    *sreqs = 0;
+    start = now();
+
+    for (i = 0; i < REQS; ++i) {
+        plan1(wl, &reqs[i], plan);
+        *sreqs += plan->sreqcount;
+    }
+
+    start = now() - start;
+
+    return (start > 0) ? start : 1e-9;
+}
+
+int main()
+{
+    unsigned i, w;
+    unsigned long sreqs;
+    double generic, special, t;
+    struct raidreq *reqs;
+    struct ioplan plan, check;
+    const struct workload *wl;
+
+    if ((reqs = (struct raidreq *) malloc(REQS * sizeof *reqs)) == NULL) {
+        fprintf(stderr, "Could not get memory for the requests.\n");
+        exit(34);
+    }
+
+    initioplan(&plan);
+    initioplan(&check);
+
+    printf("%-14s %-8s %10s %12s %10s %14s %10s %8s\n", "workload",
+      "kernel", "requests", "stripereqs", "seconds", "stripereqs/s",
+      "ns/stripe", "speedup");
+
+    for (w = 0; w < sizeof workloads / sizeof workloads[0]; ++w) {
+        wl = &workloads[w];
+        seed = 1;
+
+        for (i = 0; i < REQS; ++i) {
+            reqs[i].nature = wl->nature;
+            reqs[i].len = wl->len;
+            reqs[i].offset = wl->sequential ? i * (unsigned long) wl->len %
+              SPAN : (nextrandom() << 12) % (SPAN - wl->len);
+            reqs[i].time = 0;
+        }
+
+        agree(wl, reqs, &check, &plan);
+
+        /* The kernels take turns, so that whatever else the machine is
+         * doing weighs on both alike. */
+        generic = special = 0;
+        for (i = 0; i < RUNS; ++i) {
+            plan.generic = 1;
+            t = run(wl, reqs, &plan, &sreqs);
+            if (i == 0 || t < generic) generic = t;
+            plan.generic = 0;
+            t = run(wl, reqs, &plan, &sreqs);
+            if (i == 0 || t < special) special = t;
+        }
+
+        printf("%-14s %-8s %10lu %12lu %10.6f %14.0f %10.1f %8s\n",
+          wl->name, "generic", REQS, sreqs, generic, sreqs / generic,
+          generic * 1e9 / sreqs, "");
+        printf("%-14s %-8s %10lu %12lu %10.6f %14.0f %10.1f %8.2f\n",
+          wl->name, "geometry", REQS, sreqs, special, sreqs / special,
+          special * 1e9 / sreqs, generic / special);
+    }
+
+    freeioplan(&plan);
+    freeioplan(&check);
+    free((void *) reqs);
+
+    return 0;
+}
+
+/* vim: set cindent shiftwidth=4 expandtab: */
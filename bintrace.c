@@ -0,0 +1,381 @@
+/* File mappings are a POSIX matter. */
+#define _POSIX_C_SOURCE 200112L
+
+#include <fcntl.h>
+#include <limits.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "simint.h"
+
+/* This file hosts binary traces: a compact form of a trace against a
+ * single array, which takes no parsing to read. Numbers are unsigned and
+ * little-endian unless said otherwise. A binary trace is a header,
+ *
+ *      0  8  "reqsimbt"
+ *      8  4  version, 1
+ *     12  4  LEVEL, 4 or 5
+ *     16  4  DATADSKS
+ *     20  4  STRIPINGUNIT
+ *     24  4  FLTSTATA, two's complement
+ *     28  4  SECTOR, 0 for SECTOR (reqsim.h)
+ *     32  4  checkpoint interval, in records
+ *     36  4  reserved, 0
+ *     40  8  number of records
+ *
+ * followed by records of 16 bytes each,
+ *
+ *      0  4  OFFSET
+ *      4  4  LENGTH
+ *      8  4  microseconds since the previous record's TIME, or since 0
+ *            for the first record
+ *     12  1  0 for a read, 1 for a write, 2 for a discard
+ *     13  3  reserved, 0
+ *
+ * followed by checkpoints of 8 bytes each, the TIME of every interval-th
+ * record, starting with the first. As every record has the same length,
+ * record n may be found without reading those before it, and with the
+ * checkpoints, so may its time; a trace can thus be split among threads,
+ * each taking its own range of records.
+ *
+ * Traces are read by mapping the file, and records are decoded where
+ * they lie. Traces are written by convertbin, which takes text request
+ * records (see textrec.c) as well as the text output of blkparse, the
+ * blktrace formatter, line by line, in any mixture. Of blkparse output,
+ * queue (Q) events for reads and writes are taken; a trace made of it
+ * needs an array record ahead of the first of them, for instance
+ *
+ *     (echo a 5 4 65536 -1; blkparse -i sda) | reqsim -b trace.bin
+ *
+ * Times are made never to go backwards, as they may do slightly between
+ * CPUs in blkparse output. */
+
+#define HEADERLEN 48
+#define RECORDLEN 16
+#define CHECKPOINTLEN 8
+
+/* Records per checkpoint, in traces written. */
+#define INTERVAL 4096
+
+static unsigned long get32(const unsigned char *p)
+{
+    return p[0] | p[1] << 8 | (unsigned long) p[2] << 16 | (unsigned long)
+      p[3] << 24;
+}
+
+/* The upper half is dropped where unsigned long is 32 bits. */
+static unsigned long get64(const unsigned char *p)
+{
+    return get32(p) | (unsigned long) get32(p + 4) << 16 << 16;
+}
+
+static void put32(unsigned char *p, unsigned long n)
+{
+    p[0] = n & 0xff;
+    p[1] = n >> 8 & 0xff;
+    p[2] = n >> 16 & 0xff;
+    p[3] = n >> 24 & 0xff;
+}
+
+static void put64(unsigned char *p, unsigned long n)
+{
+    put32(p, n & 0xffffffffUL);
+    put32(p + 4, n >> 16 >> 16);
+}
+
+/* A job source reading a mapped binary trace. */
+struct binsrc {
+    struct jobsrc src;
+    const unsigned char *base;  /* The mapping. */
+    size_t size;
+    unsigned long records;
+    unsigned long interval;
+    const unsigned char *checkpoints;
+    struct dskarray array;
+    unsigned long next, end;    /* Records next to be read, and past the
+                                   last. */
+    unsigned long time;         /* The time of the record before next. */
+};
+
+static int nextbinjob(struct jobsrc *src, struct job *jb)
+{
+    struct binsrc *bs = (struct binsrc *) src;
+    const unsigned char *rec;
+
+    if (bs->next >= bs->end) return -1;
+
+    rec = bs->base + HEADERLEN + bs->next * RECORDLEN;
+
+    if (bs->next % bs->interval)
+        bs->time += get32(rec + 8);
+    else
+        bs->time = get64(bs->checkpoints + bs->next / bs->interval *
+          CHECKPOINTLEN);
+
+    jb->array = bs->array;
+    jb->req.offset = get32(rec);
+    jb->req.len = get32(rec + 4);
+    jb->req.time = bs->time;
+    jb->req.nature = (rec[12] == 2) ? DISCARDREQ : rec[12] ? WRITEREQ :
+      READREQ;
+
+    ++bs->next;
+
+    return 0;
+}
+
+static void closebinsrc(struct jobsrc *src)
+{
+    struct binsrc *bs = (struct binsrc *) src;
+
+    munmap((void *) bs->base, bs->size);
+    free((void *) bs);
+}
+
+struct jobsrc *openbinsrc(const char *path)
+{
+    int fd;
+    unsigned long checkpoints;
+    void *base;
+    const unsigned char *p;
+    struct binsrc *bs;
+    struct stat st;
+
+    if ((fd = open(path, O_RDONLY)) < 0) return NULL;
+
+    if (fstat(fd, &st) || st.st_size < HEADERLEN) {
+        close(fd);
+        return NULL;
+    }
+
+    base = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+
+    if (base == MAP_FAILED) return NULL;
+
+    p = (const unsigned char *) base;
+    if (memcmp(p, "reqsimbt", 8)) {
+        munmap(base, st.st_size);
+        return NULL;
+    }
+
+    if ((bs = (struct binsrc *) malloc(sizeof *bs)) == NULL) {
+        fprintf(stderr, "Could not get memory for a job source.\n");
+        exit(22);
+    }
+
+    bs->src.next = nextbinjob;
+    bs->src.close = closebinsrc;
+    bs->base = p;
+    bs->size = st.st_size;
+    bs->array.lvl = (get32(p + 12) == 4) ? RAID4 : RAID5;
+    bs->array.datadsks = get32(p + 16);
+    bs->array.stripingunit = get32(p + 20);
+    bs->array.fltstata = (get32(p + 24) == 0xffffffffUL) ? FLTFREE : (int)
+      get32(p + 24);
+    bs->array.sector = get32(p + 28);
+    bs->interval = get32(p + 32);
+    bs->records = get64(p + 40);
+
+    checkpoints = bs->interval ? (bs->records + bs->interval - 1) /
+      bs->interval : 0;
+
+    if (get32(p + 8) != 1 || bs->interval == 0 || (st.st_size -
+      HEADERLEN) / RECORDLEN < bs->records || (unsigned long) st.st_size !=
+      HEADERLEN + bs->records * RECORDLEN + checkpoints * CHECKPOINTLEN) {
+        fprintf(stderr, "%s: damaged binary trace.\n", path);
+        exit(23);
+    }
+
+    bs->checkpoints = p + HEADERLEN + bs->records * RECORDLEN;
+    bs->next = bs->time = 0;
+    bs->end = bs->records;
+
+    return &bs->src;
+}
+
+unsigned long binsrclen(struct jobsrc *src)
+{
+    return ((struct binsrc *) src)->records;
+}
+
+void binsrcseek(struct jobsrc *src, unsigned long first, unsigned long
+  count)
+{
+    struct binsrc *bs = (struct binsrc *) src;
+    unsigned long rec;
+
+    if (first > bs->records) first = bs->records;
+    if (count > bs->records - first) count = bs->records - first;
+
+    bs->next = first;
+    bs->end = first + count;
+
+    /* The time before the first record to be read: from the checkpoint
+     * at or before it, deltas are added up to the record itself, whose
+     * own delta nextbinjob adds in turn. */
+    bs->time = 0;
+    if (first % bs->interval) {
+        rec = first - first % bs->interval;
+        bs->time = get64(bs->checkpoints + rec / bs->interval *
+          CHECKPOINTLEN);
+        for (++rec; rec < first; ++rec)
+            bs->time += get32(bs->base + HEADERLEN + rec * RECORDLEN + 8);
+    }
+}
+
+/* This function parses one line of blkparse output, of the default
+ * format, into the request. A nonzero value is returned unless the line
+ * is a queue event for a read, a write or a discard ending within 32-bit
+ * offsets. */
+static int parseblkparse(const char *line, struct raidreq *req)
+{
+    char action[8], rwbs[8];
+    unsigned long secs, nsecs, sector, sectors;
+
+    if (sscanf(line, "%*s %*u %*u %lu.%lu %*u %7s %7s %lu + %lu", &secs,
+      &nsecs, action, rwbs, &sector, &sectors) != 6 || strcmp(action, "Q"))
+        return -1;
+
+    /* A discard is marked D, and may be marked W as well. */
+    if (strchr(rwbs, 'D') != NULL)
+        req->nature = DISCARDREQ;
+    else if (strchr(rwbs, 'R') != NULL)
+        req->nature = READREQ;
+    else if (strchr(rwbs, 'W') != NULL)
+        req->nature = WRITEREQ;
+    else
+        return -1;
+
+    /* blkparse counts in 512-byte sectors whatever the device. */
+    if (sector > UINT_MAX / 512 || sectors > UINT_MAX / 512 - sector)
+        return -1;
+
+    req->offset = sector * 512;
+    req->len = sectors * 512;
+    req->time = secs * 1000000 + nsecs / 1000;
+
+    return req->len ? 0 : -1;
+}
+
+void convertbin(FILE *in, const char *path)
+{
+    char line[256];
+    unsigned char rec[RECORDLEN], header[HEADERLEN], *checkpoints;
+    unsigned long count, delta, lineno, skipped, time, cap;
+    int havearray;
+    void *mem;
+    FILE *out;
+    struct job jb;
+    struct dskarray array;
+
+    if ((out = fopen(path, "wb")) == NULL) {
+        fprintf(stderr, "Could not create %s.\n", path);
+        exit(24);
+    }
+
+    /* The header is written again once the count is known. */
+    memset(header, 0, sizeof header);
+    fwrite(header, 1, sizeof header, out);
+
+    checkpoints = NULL;
+    count = cap = lineno = skipped = time = 0;
+    havearray = 0;
+    memset(&jb, 0, sizeof jb);
+
+    while (fgets(line, sizeof line, in) != NULL) {
+        ++lineno;
+
+        switch (parserecord(line, &jb)) {
+        case RECNONE:
+            continue;
+
+        case RECARRAY:
+            if (havearray && memcmp(&array, &jb.array, sizeof array)) {
+                fprintf(stderr, "Line %lu: a binary trace is made against "
+                  "a single array.\n", lineno);
+                exit(25);
+            }
+            array = jb.array;
+            havearray = 1;
+            continue;
+
+        case RECREQ:
+            break;
+
+        default:
+            if (parseblkparse(line, &jb.req)) {
+                ++skipped;
+                continue;
+            }
+        }
+
+        if (!havearray) {
+            fprintf(stderr, "Line %lu: request before any array.\n",
+              lineno);
+            exit(26);
+        }
+
+        if (jb.req.time < time) jb.req.time = time;
+        if ((delta = jb.req.time - time) > 0xffffffffUL) {
+            fprintf(stderr, "Line %lu: more than 2^32 microseconds after "
+              "the request before.\n", lineno);
+            exit(27);
+        }
+        time = jb.req.time;
+
+        if (count % INTERVAL == 0) {
+            if (count / INTERVAL == cap) {
+                cap = cap ? 2 * cap : 64;
+                if ((mem = realloc((void *) checkpoints, cap *
+                  CHECKPOINTLEN)) == NULL) {
+                    fprintf(stderr, "Could not get memory for "
+                      "checkpoints.\n");
+                    exit(28);
+                }
+                checkpoints = (unsigned char *) mem;
+            }
+            put64(checkpoints + count / INTERVAL * CHECKPOINTLEN, time);
+        }
+
+        put32(rec, jb.req.offset);
+        put32(rec + 4, jb.req.len);
+        put32(rec + 8, delta);
+        rec[12] = (jb.req.nature == DISCARDREQ) ? 2 : jb.req.nature ==
+          WRITEREQ;
+        rec[13] = rec[14] = rec[15] = 0;
+        fwrite(rec, 1, sizeof rec, out);
+
+        ++count;
+    }
+
+    if (count)
+        fwrite(checkpoints, CHECKPOINTLEN, (count + INTERVAL - 1) /
+          INTERVAL, out);
+
+    if (havearray) {
+        memcpy(header, "reqsimbt", 8);
+        put32(header + 8, 1);
+        put32(header + 12, (array.lvl == RAID4) ? 4 : 5);
+        put32(header + 16, array.datadsks);
+        put32(header + 20, array.stripingunit);
+        put32(header + 24, (unsigned long) array.fltstata & 0xffffffffUL);
+        put32(header + 28, array.sector);
+        put32(header + 32, INTERVAL);
+        put64(header + 40, count);
+    }
+
+    if (fseek(out, 0, SEEK_SET) || fwrite(header, 1, sizeof header, out) !=
+      sizeof header || fclose(out)) {
+        fprintf(stderr, "Could not write %s.\n", path);
+        exit(29);
+    }
+
+    free((void *) checkpoints);
+
+    fprintf(stderr, "%lu records written, %lu lines skipped.\n", count,
+      skipped);
+}
+
+/* vim: set cindent shiftwidth=4 expandtab: */
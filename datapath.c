@@ -0,0 +1,524 @@
+/* Clocks are a POSIX matter. */
+#define _POSIX_C_SOURCE 200112L
+
+#include <time.h>
+
+#include "simint.h"
+
+/* This file hosts the data path: a backend which carries plans out on an
+ * array kept in memory, to see that they actually work. Each disk is a
+ * buffer, filled with random data and consistent parity before a job
+ * runs. A write plan is then executed using nothing but what it says to
+ * read: new parity is worked out sector by sector, either from all the
+ * data units (the reconstruct-write way) or from the old parity and the
+ * change in data (the read-modify-write way), with rw+ plans mixing the
+ * two by sector. The planned writes are applied, and the array is
+ * checked against a model of what it should hold: data on every working
+ * disk, and parity that matches the data. Every write is followed by a
+ * read of the same range, so in a degraded array the reconstruction of
+ * data on the faulty disk is checked too.
+ *
+ * Plans fail in three ways: they may leave out a read something depends
+ * on (insufficient), read the faulty disk, or leave the array in a state
+ * other than the model (inconsistent). */
+
+extern const char xorflavour[];
+extern void xorblock(unsigned char *dst, const unsigned char *src,
+  unsigned len);
+
+/* The array being worked on, covering the stripes of one job. */
+struct dpstate {
+    const struct dskarray *array;
+    unsigned dsks;        /* Disks, the parity disk included. */
+    unsigned unitlen;     /* The striping unit. */
+    unsigned sector;
+    unsigned unitsectors;
+    unsigned dskwords;    /* Words in the bitmap of one disk. */
+    unsigned firststripe; /* The first stripe covered. */
+    unsigned stripes;     /* Stripes covered. */
+    unsigned char *phys;  /* Disk contents, by stripe and disk. */
+    unsigned char *model; /* What the array should hold, by stripe and
+                             unit. Includes the faulty disk. */
+    /* Per stripe request: what was read, by disk, the sectors read, and
+     * new data, by unit. */
+    unsigned char *rdbuf;
+    unsigned long *avail;
+    unsigned char *newbuf;
+    /* The stripe request at hand: its stripe, and the bytes of the RAID
+     * request in it, relative to the start of the stripe. */
+    unsigned stripe;
+    unsigned reqlo, reqhi;
+    unsigned char *acc, *tmp, *tmp2; /* Sector-sized scratch. */
+    double xorbytes;                 /* Bytes XORed. */
+};
+
+/* What becomes of a stripe plan. */
+enum dpoutcome {DPOK, DPINSUFFICIENT, DPFAULTYREAD, DPINCONSISTENT};
+
+/* Tallies over all jobs. */
+struct dpstats {
+    unsigned long sreqs, ok, insufficient, faultyread, inconsistent;
+};
+
+static double now()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* XOR with accounting. */
+static void xorsector(struct dpstate *st, unsigned char *dst, const
+  unsigned char *src)
+{
+    xorblock(dst, src, st->sector);
+    st->xorbytes += st->sector;
+}
+
+/* This function maps a unit of a stripe to the disk it is on. It is the
+ * inverse of disktounit in libreqsim.c. */
+static unsigned unittodisk(struct dpstate *st, unsigned stripe, unsigned
+  unit)
+{
+    return (st->array->lvl == RAID4) ? unit : (unit + st->dsks - stripe %
+      st->dsks) % st->dsks;
+}
+
+/* Locations in the buffers. */
+static unsigned char *physat(struct dpstate *st, unsigned stripe, unsigned
+  disk, unsigned sec)
+{
+    return st->phys + ((stripe - st->firststripe) * st->dsks + disk) *
+      st->unitlen + sec * st->sector;
+}
+
+static unsigned char *modelat(struct dpstate *st, unsigned stripe,
+  unsigned unit, unsigned sec)
+{
+    return st->model + ((stripe - st->firststripe) * st->dsks + unit) *
+      st->unitlen + sec * st->sector;
+}
+
+static void randomfill(unsigned char *buf, unsigned long len)
+{
+    while (len--) *buf++ = rand() >> 4;
+}
+
+/* This function sets up an array covering the stripes of a plan, with
+ * random data and consistent parity. */
+static void setup(struct dpstate *st, const struct dskarray *array, struct
+  ioplan *plan)
+{
+    unsigned long bytes;
+    unsigned sec, stripe, unit;
+
+    st->array = array;
+    st->dsks = array->datadsks + 1;
+    st->unitlen = array->stripingunit;
+    st->sector = ARRAYSECTOR(array);
+    st->unitsectors = st->unitlen / st->sector;
+    st->dskwords = SECMAPWORDS(st->unitsectors);
+    st->firststripe = plan->sreqs->stripe;
+    st->stripes = plan->sreqs[plan->sreqcount - 1].stripe + 1 -
+      st->firststripe;
+
+    bytes = (unsigned long) st->stripes * st->dsks * st->unitlen;
+
+    if ((st->phys = (unsigned char *) malloc(bytes)) == NULL ||
+      (st->model = (unsigned char *) malloc(bytes)) == NULL ||
+      (st->rdbuf = (unsigned char *) malloc(st->dsks * st->unitlen)) ==
+      NULL || (st->newbuf = (unsigned char *) malloc(st->dsks *
+      st->unitlen)) == NULL || (st->avail = (unsigned long *)
+      malloc(st->dsks * st->dskwords * sizeof *st->avail)) == NULL ||
+      (st->acc = (unsigned char *) malloc(3 * st->sector)) == NULL) {
+        fprintf(stderr, "Could not get memory for the in-memory array.\n");
+        exit(15);
+    }
+    st->tmp = st->acc + st->sector;
+    st->tmp2 = st->tmp + st->sector;
+
+    /* The model is kept by unit, with the parity unit last. */
+    randomfill(st->model, bytes);
+
+    for (stripe = st->firststripe; stripe < st->firststripe + st->stripes;
+      ++stripe)
+        for (sec = 0; sec < st->unitsectors; ++sec) {
+            memset(modelat(st, stripe, array->datadsks, sec), 0,
+              st->sector);
+            for (unit = 0; unit < array->datadsks; ++unit)
+                xorsector(st, modelat(st, stripe, array->datadsks, sec),
+                  modelat(st, stripe, unit, sec));
+            for (unit = 0; unit < st->dsks; ++unit)
+                memcpy(physat(st, stripe, unittodisk(st, stripe, unit),
+                  sec), modelat(st, stripe, unit, sec), st->sector);
+        }
+}
+
+static void teardown(struct dpstate *st)
+{
+    free((void *) st->phys);
+    free((void *) st->model);
+    free((void *) st->rdbuf);
+    free((void *) st->newbuf);
+    free((void *) st->avail);
+    free((void *) st->acc);
+}
+
+/* This function tells how much of sector sec of a data unit the request
+ * covers: 0 for none, 1 for part, 2 for all of it. The covered bytes,
+ * relative to the sector, go to lo and hi. */
+static int coverage(struct dpstate *st, unsigned unit, unsigned sec,
+  unsigned *lo, unsigned *hi)
+{
+    unsigned b0, b1;
+
+    b0 = unit * st->unitlen + sec * st->sector;
+    b1 = b0 + st->sector;
+
+    *lo = (st->reqlo > b0) ? st->reqlo : b0;
+    *hi = (st->reqhi < b1) ? st->reqhi : b1;
+
+    if (*hi <= *lo) return 0;
+
+    *lo -= b0;
+    *hi -= b0;
+
+    return (*lo == 0 && *hi == st->sector) ? 2 : 1;
+}
+
+static int wasread(struct dpstate *st, unsigned disk, unsigned sec)
+{
+    return st->avail[disk * st->dskwords + sec / SECMAPBITS] >> sec %
+      SECMAPBITS & 1;
+}
+
+/* This function works out the contents of a unit's sector before the
+ * write, from what was read: directly, or, for the faulty disk, from
+ * parity and the other data units. */
+static int oldval(struct dpstate *st, unsigned unit, unsigned sec,
+  unsigned char *out)
+{
+    unsigned disk, other;
+
+    disk = unittodisk(st, st->stripe, unit);
+
+    if ((int) disk != st->array->fltstata) {
+        if (!wasread(st, disk, sec)) return -1;
+        memcpy(out, st->rdbuf + disk * st->unitlen + sec * st->sector,
+          st->sector);
+        return 0;
+    }
+
+    memset(out, 0, st->sector);
+    for (other = 0; other < st->dsks; ++other) {
+        if (other == disk) continue;
+        if (!wasread(st, other, sec)) return -1;
+        xorsector(st, out, st->rdbuf + other * st->unitlen + sec *
+          st->sector);
+    }
+
+    return 0;
+}
+
+/* This function works out the contents of a data unit's sector after the
+ * write. */
+static int newval(struct dpstate *st, unsigned unit, unsigned sec,
+  unsigned char *out)
+{
+    unsigned hi, lo;
+    const unsigned char *src;
+
+    src = st->newbuf + unit * st->unitlen + sec * st->sector;
+
+    switch (coverage(st, unit, sec, &lo, &hi)) {
+    case 0:
+        return oldval(st, unit, sec, out);
+    case 1:
+        if (oldval(st, unit, sec, out)) return -1;
+        memcpy(out + lo, src + lo, hi - lo);
+        return 0;
+    default:
+        memcpy(out, src, st->sector);
+        return 0;
+    }
+}
+
+/* This function works out the new parity of a sector into st->acc, the
+ * reconstruct-write way if what was read allows it, and the
+ * read-modify-write way otherwise. */
+static int newparity(struct dpstate *st, unsigned sec)
+{
+    unsigned hi, lo, pdisk, unit;
+
+    for (unit = 0; unit < st->array->datadsks; ++unit) {
+        if (newval(st, unit, sec, st->tmp)) break;
+        if (unit == 0)
+            memcpy(st->acc, st->tmp, st->sector);
+        else
+            xorsector(st, st->acc, st->tmp);
+    }
+    if (unit == st->array->datadsks) return 0;
+
+    pdisk = unittodisk(st, st->stripe, st->array->datadsks);
+    if (!wasread(st, pdisk, sec)) return -1;
+    memcpy(st->acc, st->rdbuf + pdisk * st->unitlen + sec * st->sector,
+      st->sector);
+
+    for (unit = 0; unit < st->array->datadsks; ++unit) {
+        if (coverage(st, unit, sec, &lo, &hi) == 0) continue;
+        if (oldval(st, unit, sec, st->tmp) || newval(st, unit, sec,
+          st->tmp2))
+            return -1;
+        xorsector(st, st->acc, st->tmp);
+        xorsector(st, st->acc, st->tmp2);
+    }
+
+    return 0;
+}
+
+/* This function carries out the reads of a stripe plan. It fails if the
+ * faulty disk is to be read. */
+static int doreads(struct dpstate *st, struct stripeplan *sp)
+{
+    unsigned disk;
+    struct unitscope *rd;
+
+    secmapclear(st->avail, st->dsks * st->dskwords * SECMAPBITS);
+
+    for (disk = 0; disk < st->dsks; ++disk) {
+        rd = &sp->rd[disk];
+        if (rd->len == 0) continue;
+        if ((int) disk == st->array->fltstata) return -1;
+
+        memcpy(st->rdbuf + disk * st->unitlen + rd->offset, physat(st,
+          st->stripe, disk, 0) + rd->offset, rd->len);
+        secmapset(st->avail + disk * st->dskwords, rd->offset / st->sector,
+          rd->len / st->sector);
+    }
+
+    return 0;
+}
+
+/* This function tells whether the planned writes cover sector sec of a
+ * disk. */
+static int written(struct stripeplan *sp, unsigned disk, unsigned byte)
+{
+    return byte >= sp->wr[disk].offset && byte < sp->wr[disk].offset +
+      sp->wr[disk].len;
+}
+
+/* This function executes a write stripe plan and checks the outcome.
+ * New contents of each sector are worked out in full before anything is
+ * written, as a real implementation would. */
+static enum dpoutcome dowrite(struct dpstate *st, struct stripeplan *sp)
+{
+    unsigned char *out;
+    unsigned disk, hi, lo, pdisk, sec, unit;
+
+    if (doreads(st, sp)) return DPFAULTYREAD;
+
+    randomfill(st->newbuf, st->dsks * st->unitlen);
+
+    pdisk = unittodisk(st, st->stripe, st->array->datadsks);
+
+    /* New data goes to a scratch copy of the stripe first. */
+    if ((out = (unsigned char *) malloc(st->dsks * st->unitlen)) == NULL) {
+        fprintf(stderr, "Could not get memory for the in-memory array.\n");
+        exit(15);
+    }
+    memcpy(out, physat(st, st->stripe, 0, 0), st->dsks * st->unitlen);
+
+    for (sec = 0; sec < st->unitsectors; ++sec) {
+        for (unit = 0; unit < st->array->datadsks; ++unit) {
+            disk = unittodisk(st, st->stripe, unit);
+            if ((int) disk == st->array->fltstata) continue;
+            if (!written(sp, disk, sec * st->sector)) continue;
+            if (newval(st, unit, sec, out + disk * st->unitlen + sec *
+              st->sector)) {
+                free((void *) out);
+                return DPINSUFFICIENT;
+            }
+        }
+
+        if ((int) pdisk != st->array->fltstata && written(sp, pdisk, sec *
+          st->sector)) {
+            if (newparity(st, sec)) {
+                free((void *) out);
+                return DPINSUFFICIENT;
+            }
+            memcpy(out + pdisk * st->unitlen + sec * st->sector, st->acc,
+              st->sector);
+        }
+
+        /* The model, worked out from itself rather than from the disks. */
+        for (unit = 0; unit < st->array->datadsks; ++unit)
+            if (coverage(st, unit, sec, &lo, &hi))
+                memcpy(modelat(st, st->stripe, unit, sec) + lo, st->newbuf
+                  + unit * st->unitlen + sec * st->sector + lo, hi - lo);
+        memset(modelat(st, st->stripe, st->array->datadsks, sec), 0,
+          st->sector);
+        for (unit = 0; unit < st->array->datadsks; ++unit)
+            xorsector(st, modelat(st, st->stripe, st->array->datadsks, sec),
+              modelat(st, st->stripe, unit, sec));
+    }
+
+    memcpy(physat(st, st->stripe, 0, 0), out, st->dsks * st->unitlen);
+    free((void *) out);
+
+    /* Every working disk must now agree with the model. */
+    for (unit = 0; unit < st->dsks; ++unit) {
+        disk = unittodisk(st, st->stripe, unit);
+        if ((int) disk == st->array->fltstata) continue;
+        if (memcmp(physat(st, st->stripe, disk, 0), modelat(st, st->stripe,
+          unit, 0), st->unitlen))
+            return DPINCONSISTENT;
+    }
+
+    return DPOK;
+}
+
+/* This function executes a read stripe plan and checks that what it
+ * returns is what the array holds. */
+static enum dpoutcome doread(struct dpstate *st, struct stripeplan *sp)
+{
+    unsigned hi, lo, sec, unit;
+
+    if (doreads(st, sp)) return DPFAULTYREAD;
+
+    for (unit = 0; unit < st->array->datadsks; ++unit)
+        for (sec = 0; sec < st->unitsectors; ++sec) {
+            if (coverage(st, unit, sec, &lo, &hi) == 0) continue;
+            if (oldval(st, unit, sec, st->tmp)) return DPINSUFFICIENT;
+            if (memcmp(st->tmp + lo, modelat(st, st->stripe, unit, sec) +
+              lo, hi - lo))
+                return DPINCONSISTENT;
+        }
+
+    return DPOK;
+}
+
+/* This function executes every stripe plan of a RAID request. */
+static void execute(struct dpstate *st, struct raidreq *rreq, struct
+  ioplan *plan, struct dpstats *stats)
+{
+    static const char *what[] = {"", "is insufficient", "reads the faulty "
+      "disk", "leaves the array inconsistent"};
+    unsigned stripelen, sreqnum;
+    enum dpoutcome outcome;
+    struct stripeplan *sp;
+
+    stripelen = st->array->datadsks * st->unitlen;
+
+    for (sreqnum = 0; sreqnum < plan->sreqcount; ++sreqnum) {
+        sp = &plan->sreqs[sreqnum];
+        st->stripe = sp->stripe;
+
+        /* The request's own bytes, not the whole sectors planned. */
+        st->reqlo = (rreq->offset > sp->offset) ? rreq->offset - sp->offset
+          : 0;
+        st->reqhi = ((rreq->offset + rreq->len < sp->offset + sp->len) ?
+          rreq->offset + rreq->len - sp->offset : sp->len);
+        st->reqlo += sp->offset % stripelen;
+        st->reqhi += sp->offset % stripelen;
+
+        outcome = (rreq->nature == WRITEREQ) ? dowrite(st, sp) :
+          doread(st, sp);
+
+        ++stats->sreqs;
+        switch (outcome) {
+        case DPOK:
+            ++stats->ok;
+            break;
+        case DPINSUFFICIENT:
+            ++stats->insufficient;
+            break;
+        case DPFAULTYREAD:
+            ++stats->faultyread;
+            break;
+        default:
+            ++stats->inconsistent;
+        }
+
+        if (outcome != DPOK)
+            printf("%s of stripe %u (offset %u, length %u) %s\n",
+              (rreq->nature == WRITEREQ) ? "Write" : "Read", sp->stripe,
+              sp->offset, sp->len, what[outcome]);
+    }
+}
+
+/* This function times the XOR kernel on its own, over blocks that stay in
+ * the cache, and prints the result. */
+static void benchxor()
+{
+    enum {BLOCK = 65536, ROUNDS = 4096};
+    static unsigned char dst[BLOCK], src[BLOCK];
+    unsigned round;
+    double start, elapsed;
+
+    randomfill(dst, BLOCK);
+    randomfill(src, BLOCK);
+
+    start = now();
+    for (round = 0; round < ROUNDS; ++round) xorblock(dst, src, BLOCK);
+    elapsed = now() - start;
+
+    /* Keep the work from being thrown away. */
+    if (dst[0] == 1 && dst[BLOCK - 1] == 2) putchar('\0');
+
+    printf("XOR kernel (%s): %.0f MiB in %.6f s, %.2f GB/s\n", xorflavour,
+      (double) BLOCK * ROUNDS / 1048576, elapsed, (double) BLOCK * ROUNDS
+      / elapsed / 1e9);
+}
+
+/* This function runs every job from the source on the in-memory array.
+ * Writes are followed by a read of the same range. */
+void rundatapath(struct jobsrc *src)
+{
+    struct dpstate st;
+    struct dpstats stats;
+    struct job jb;
+    struct raidreq reread;
+    struct ioplan plan;
+
+    memset(&stats, 0, sizeof stats);
+    st.xorbytes = 0;
+
+    initioplan(&plan);
+    plan.model = costmodel;
+    srand(1);
+
+    while (src->next(src, &jb) == 0) {
+        /* A discard moves no data, so there is nothing to execute. */
+        if (jb.req.nature == DISCARDREQ) continue;
+
+        if (planraidreq(&jb.array, &jb.req, &plan)) {
+            fprintf(stderr, "Could not plan the RAID request; "
+              "skipped.\n");
+            continue;
+        }
+
+        setup(&st, &jb.array, &plan);
+        execute(&st, &jb.req, &plan, &stats);
+
+        if (jb.req.nature == WRITEREQ) {
+            reread = jb.req;
+            reread.nature = READREQ;
+            planraidreq(&jb.array, &reread, &plan);
+            execute(&st, &reread, &plan, &stats);
+        }
+
+        teardown(&st);
+    }
+
+    freeioplan(&plan);
+
+    printf("%lu stripe requests executed: %lu correct, %lu insufficient, "
+      "%lu reading the faulty disk, %lu inconsistent\n", stats.sreqs,
+      stats.ok, stats.insufficient, stats.faultyread, stats.inconsistent);
+    printf("%.0f bytes XORed\n", st.xorbytes);
+    benchxor();
+}
+
+/* vim: set cindent shiftwidth=4 expandtab: */
@@ -0,0 +1,59 @@
+#include "simint.h"
+
+/* This file keeps time by disk for the simulations that run jobs at their
+ * arrival times, such as the reshape (reshape.c). Every disk has a clock,
+ * the time up to which it is busy, and the operations put on a disk are
+ * charged to it by disktime (libreqsim.c) under a cost model, first come,
+ * first served. A plan's writes start once its reads are done. */
+
+double chargephase(const struct devmodel *model, double *clock, unsigned
+  dsks, const struct dskphase *ph, double at)
+{
+    unsigned disk;
+    double end;
+
+    end = at;
+
+    for (disk = 0; disk < dsks; ++disk) {
+        if (ph->ops[disk] == 0) continue;
+
+        if (clock[disk] < at) clock[disk] = at;
+        clock[disk] += disktime(model, ph->ops[disk], ph->bytes[disk]);
+        if (clock[disk] > end) end = clock[disk];
+    }
+
+    return end;
+}
+
+void gatherphase(struct dskphase *ph, const struct ioplan *plan, unsigned
+  dsks, int write)
+{
+    unsigned disk;
+    const struct unitscope *scope;
+    const struct stripeplan *sp;
+
+    memset(ph, 0, sizeof *ph);
+
+    for (sp = plan->sreqs; sp < plan->sreqs + plan->sreqcount; ++sp)
+        for (disk = 0; disk < dsks; ++disk) {
+            scope = write ? &sp->wr[disk] : &sp->rd[disk];
+            if (scope->len) {
+                ++ph->ops[disk];
+                ph->bytes[disk] += scope->len;
+            }
+        }
+}
+
+double chargeplan(const struct devmodel *model, double *clock, unsigned
+  dsks, const struct ioplan *plan, double at)
+{
+    struct dskphase ph;
+
+    gatherphase(&ph, plan, dsks, 0);
+    at = chargephase(model, clock, dsks, &ph, at);
+    gatherphase(&ph, plan, dsks, 1);
+
+    return chargephase(model, clock, dsks, &ph, at);
+}
+
+/* vim: set cindent shiftwidth=4 expandtab: */
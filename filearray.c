@@ -0,0 +1,440 @@
+/* O_DIRECT, syscall and posix_memalign are beyond POSIX proper. */
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <linux/fs.h>
+#include <linux/io_uring.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+
+#include "simint.h"
+
+/* This file replays plans on real storage. Disk n of the array is backed
+ * by the file, or block device, named by the given prefix followed by n,
+ * for example /tmp/disk0, /tmp/disk1 and so on for the prefix /tmp/disk.
+ * Missing files are created, and regular files are grown (sparsely) to
+ * cover the stripes used; for meaningful numbers they should be
+ * preallocated. Files are opened with O_DIRECT where that is allowed,
+ * and the array's sectors are a multiple of the device's logical blocks,
+ * so that the page cache stays out of the way.
+ *
+ * Stripe requests are taken in batches. The reads of a batch go out
+ * together, and only once they have all completed do the writes of the
+ * batch go out, since new data and parity depend on what is read. On
+ * Linux, I/O is submitted through io_uring; elsewhere, or if io_uring
+ * cannot be set up, it is done one operation at a time with pread and
+ * pwrite. Throughput and operations per second are reported by service
+ * method, the time of a batch being shared among its stripe requests in
+ * proportion to their bytes. */
+
+/* Operations in flight at once, at most. */
+#define QDEPTH 64
+
+/* Alignment of the operation buffers, and so the largest logical block
+ * O_DIRECT can be kept for. */
+#define BUFALIGN 4096
+
+/* One disk operation. */
+struct diskio {
+    int write;
+    int fd;
+    unsigned long offset;
+    unsigned len;
+    unsigned char *buf;
+};
+
+/* Accounting per service method. */
+struct methodstats {
+    unsigned long sreqs, ops;
+    double bytes, time;
+};
+
+#ifdef __linux__
+/* A raw io_uring, set up without liburing. */
+struct uring {
+    int fd;
+    unsigned *sqhead, *sqtail, *sqmask, *sqarray;
+    unsigned *cqhead, *cqtail, *cqmask;
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+};
+
+static int uringsetup(struct uring *ring)
+{
+    struct io_uring_params p;
+    unsigned char *sq, *cq;
+    size_t sqlen, cqlen;
+
+    memset(&p, 0, sizeof p);
+
+    if ((ring->fd = syscall(__NR_io_uring_setup, QDEPTH, &p)) < 0)
+        return -1;
+
+    sqlen = p.sq_off.array + p.sq_entries * sizeof (unsigned);
+    cqlen = p.cq_off.cqes + p.cq_entries * sizeof (struct io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP && cqlen > sqlen)
+        sqlen = cqlen;
+
+    sq = (unsigned char *) mmap(NULL, sqlen, PROT_READ | PROT_WRITE,
+      MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+    if (sq == MAP_FAILED) goto fail;
+
+    if (p.features & IORING_FEAT_SINGLE_MMAP)
+        cq = sq;
+    else if ((cq = (unsigned char *) mmap(NULL, cqlen, PROT_READ |
+      PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd,
+      IORING_OFF_CQ_RING)) == MAP_FAILED)
+        goto fail;
+
+    ring->sqes = (struct io_uring_sqe *) mmap(NULL, p.sq_entries * sizeof
+      (struct io_uring_sqe), PROT_READ | PROT_WRITE, MAP_SHARED |
+      MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+    if (ring->sqes == MAP_FAILED) goto fail;
+
+    ring->sqhead = (unsigned *) (sq + p.sq_off.head);
+    ring->sqtail = (unsigned *) (sq + p.sq_off.tail);
+    ring->sqmask = (unsigned *) (sq + p.sq_off.ring_mask);
+    ring->sqarray = (unsigned *) (sq + p.sq_off.array);
+    ring->cqhead = (unsigned *) (cq + p.cq_off.head);
+    ring->cqtail = (unsigned *) (cq + p.cq_off.tail);
+    ring->cqmask = (unsigned *) (cq + p.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe *) (cq + p.cq_off.cqes);
+
+    return 0;
+
+fail:
+    close(ring->fd);
+    return -1;
+}
+
+/* This function submits a batch of operations and waits for all of them
+ * to complete. */
+static int uringrun(struct uring *ring, struct diskio *ios, unsigned count)
+{
+    struct io_uring_sqe *sqe;
+    struct io_uring_cqe *cqe;
+    unsigned head, i, tail;
+    int failed;
+
+    tail = *ring->sqtail;
+
+    for (i = 0; i < count; ++i) {
+        sqe = &ring->sqes[tail & *ring->sqmask];
+        memset(sqe, 0, sizeof *sqe);
+        sqe->opcode = ios[i].write ? IORING_OP_WRITE : IORING_OP_READ;
+        sqe->fd = ios[i].fd;
+        sqe->off = ios[i].offset;
+        sqe->addr = (unsigned long) ios[i].buf;
+        sqe->len = ios[i].len;
+        sqe->user_data = i;
+        ring->sqarray[tail & *ring->sqmask] = tail & *ring->sqmask;
+        ++tail;
+    }
+
+    __atomic_store_n(ring->sqtail, tail, __ATOMIC_RELEASE);
+
+    if (syscall(__NR_io_uring_enter, ring->fd, count, count,
+      IORING_ENTER_GETEVENTS, NULL, 0) < 0)
+        return -1;
+
+    failed = 0;
+    head = *ring->cqhead;
+
+    for (i = 0; i < count; ++i) {
+        while (head == __atomic_load_n(ring->cqtail, __ATOMIC_ACQUIRE))
+            if (syscall(__NR_io_uring_enter, ring->fd, 0, 1,
+              IORING_ENTER_GETEVENTS, NULL, 0) < 0)
+                return -1;
+
+        cqe = &ring->cqes[head & *ring->cqmask];
+        if (cqe->res != (int) ios[cqe->user_data].len) failed = 1;
+        ++head;
+    }
+
+    __atomic_store_n(ring->cqhead, head, __ATOMIC_RELEASE);
+
+    return failed ? -1 : 0;
+}
+#endif
+
+/* The fallback: one operation at a time. A short transfer is a failure,
+ * as it is above. */
+static int syncrun(struct diskio *ios, unsigned count)
+{
+    unsigned i;
+    ssize_t n;
+
+    for (i = 0; i < count; ++i) {
+        n = ios[i].write ? pwrite(ios[i].fd, ios[i].buf, ios[i].len,
+          ios[i].offset) : pread(ios[i].fd, ios[i].buf, ios[i].len,
+          ios[i].offset);
+        if (n != (ssize_t) ios[i].len) return -1;
+    }
+
+    return 0;
+}
+
+static double now()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* The replay as a whole. */
+static const char *prefix;
+static int fds[MAXDISKS];    /* Open disks, -1 for those not opened. */
+static int direct[MAXDISKS]; /* Whether a disk is open with O_DIRECT. */
+static int haveuring;
+#ifdef __linux__
+static struct uring ring;
+#endif
+static unsigned char *iobuf; /* One striping unit per operation. */
+static unsigned iobufunit;   /* The striping unit iobuf is sized for. */
+static struct methodstats mstats[RRMETHOD + 1];
+
+/* This function returns the logical block size of the device behind fd:
+ * that of a block device itself, or the preferred block size of a file,
+ * which is no smaller than that of its file system. */
+static unsigned long blocksize(int fd, const struct stat *sb)
+{
+#ifdef BLKSSZGET
+    int size;
+
+    if (S_ISBLK(sb->st_mode) && ioctl(fd, BLKSSZGET, &size) == 0 && size >
+      0)
+        return size;
+#endif
+
+    return sb->st_blksize > 0 ? sb->st_blksize : 512;
+}
+
+/* This function opens the file backing a disk and makes sure it covers
+ * len bytes. O_DIRECT is kept only while sector is a multiple of the
+ * device's logical block size, as every operation, whose offset and
+ * length are whole sectors of the array, must then be aligned to it. */
+static int opendisk(unsigned disk, unsigned long len, unsigned sector)
+{
+    char path[4096];
+    struct stat sb;
+    unsigned long size;
+    int fd;
+
+    if (disk >= MAXDISKS) {
+        fprintf(stderr, "Too many disks for a file-backed array.\n");
+        exit(16);
+    }
+
+    if ((fd = fds[disk]) < 0) {
+        sprintf(path, "%.4000s%u", prefix, disk);
+
+        if ((fd = open(path, O_RDWR | O_CREAT | O_DIRECT, 0644)) >= 0)
+            direct[disk] = 1;
+        else if (errno == EINVAL)
+            fd = open(path, O_RDWR | O_CREAT, 0644);
+
+        if (fd < 0) {
+            fprintf(stderr, "Could not open %s.\n", path);
+            exit(17);
+        }
+
+        fds[disk] = fd;
+    }
+
+    if (fstat(fd, &sb)) {
+        fprintf(stderr, "Could not examine the file for disk %u.\n",
+          disk);
+        exit(55);
+    }
+
+    if (direct[disk] && ((size = blocksize(fd, &sb)) > BUFALIGN || sector %
+      size)) {
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_DIRECT);
+        direct[disk] = 0;
+    }
+
+    if (S_ISREG(sb.st_mode) && (unsigned long) sb.st_size < len &&
+      ftruncate(fd, len)) {
+        fprintf(stderr, "Could not grow the file for disk %u.\n", disk);
+        exit(18);
+    }
+
+    return fd;
+}
+
+/* This function runs a batch of operations and returns the time taken. */
+static double runbatch(struct diskio *ios, unsigned count)
+{
+    double start;
+    int failed;
+
+    start = now();
+
+#ifdef __linux__
+    if (haveuring)
+        failed = uringrun(&ring, ios, count);
+    else
+#endif
+        failed = syncrun(ios, count);
+
+    if (failed) {
+        fprintf(stderr, "A disk operation failed or fell short.\n");
+        exit(19);
+    }
+
+    return now() - start;
+}
+
+/* This function replays the stripe plans of one RAID request. */
+static void replay(struct job *jb, struct ioplan *plan)
+{
+    static struct diskio ios[QDEPTH];
+    unsigned batchend, count, dsks, disk, first, i, phase, unitlen;
+    unsigned long dsklen;
+    double bytes, rdtime, wrtime;
+    struct stripeplan *sp;
+    struct unitscope *scope;
+
+    dsks = jb->array.datadsks + 1;
+    unitlen = jb->array.stripingunit;
+    dsklen = (unsigned long) (plan->sreqs[plan->sreqcount - 1].stripe + 1)
+      * unitlen;
+
+    /* Disks whose blocks are larger than the array's sectors go through
+     * the page cache. */
+    for (disk = 0; disk < dsks; ++disk)
+        opendisk(disk, dsklen, ARRAYSECTOR(&jb->array));
+
+    if (unitlen > iobufunit) {
+        free((void *) iobuf);
+        if (posix_memalign((void **) &iobuf, BUFALIGN, (size_t) QDEPTH *
+          unitlen)) {
+            fprintf(stderr, "Could not get memory for disk operations.\n");
+            exit(20);
+        }
+        memset(iobuf, 0, (size_t) QDEPTH * unitlen);
+        iobufunit = unitlen;
+    }
+
+    /* Batches are as many stripe requests as keep both phases within the
+     * queue depth. */
+    for (first = 0; first < plan->sreqcount; first = batchend) {
+        batchend = first;
+        count = 0;
+        while (batchend < plan->sreqcount && count + 2 * dsks <= QDEPTH) {
+            count += 2 * dsks;
+            ++batchend;
+        }
+        if (batchend == first) ++batchend;
+
+        rdtime = wrtime = 0;
+
+        for (phase = 0; phase < 2; ++phase) {
+            count = 0;
+
+            for (i = first; i < batchend; ++i)
+                for (disk = 0; disk < dsks; ++disk) {
+                    sp = &plan->sreqs[i];
+                    scope = phase ? &sp->wr[disk] : &sp->rd[disk];
+                    if (scope->len == 0) continue;
+
+                    ios[count].write = phase;
+                    ios[count].fd = fds[disk];
+                    ios[count].offset = (unsigned long) sp->stripe *
+                      unitlen + scope->offset;
+                    ios[count].len = scope->len;
+                    ios[count].buf = iobuf + (size_t) count * unitlen;
+                    ++count;
+                }
+
+            if (count) {
+                if (phase)
+                    wrtime = runbatch(ios, count);
+                else
+                    rdtime = runbatch(ios, count);
+            }
+        }
+
+        bytes = 0;
+        for (i = first; i < batchend; ++i)
+            bytes += plan->sreqs[i].rdbytes + plan->sreqs[i].wrbytes;
+
+        for (i = first; i < batchend; ++i) {
+            sp = &plan->sreqs[i];
+            ++mstats[sp->method].sreqs;
+            mstats[sp->method].ops += sp->rdops + sp->wrops;
+            mstats[sp->method].bytes += sp->rdbytes + sp->wrbytes;
+            if (bytes)
+                mstats[sp->method].time += (rdtime + wrtime) *
+                  (sp->rdbytes + sp->wrbytes) / bytes;
+        }
+    }
+}
+
+/* This function replays every job from the source on the files named by
+ * pfx, then prints what was achieved per service method. */
+void runfilearray(struct jobsrc *src, const char *pfx)
+{
+    static const char *names[] = {"nw", "rmw", "rw", "rw+", "dr", "rr"};
+    unsigned i;
+    double time;
+    struct job jb;
+    struct ioplan plan;
+
+    prefix = pfx;
+    for (i = 0; i < MAXDISKS; ++i) {
+        fds[i] = -1;
+        direct[i] = 0;
+    }
+
+#ifdef __linux__
+    haveuring = uringsetup(&ring) == 0;
+#endif
+    if (!haveuring)
+        fprintf(stderr, "io_uring is not available; using pread and "
+          "pwrite.\n");
+
+    initioplan(&plan);
+    plan.model = costmodel;
+
+    while (src->next(src, &jb) == 0) {
+        if (planraidreq(&jb.array, &jb.req, &plan)) {
+            fprintf(stderr, "Could not plan the RAID request; "
+              "skipped.\n");
+            continue;
+        }
+
+        replay(&jb, &plan);
+    }
+
+    freeioplan(&plan);
+
+    printf("%-6s %10s %10s %12s %10s %12s\n", "method", "stripereqs",
+      "ops", "MB", "MB/s", "IOPS");
+
+    for (i = 0; i <= RRMETHOD; ++i) {
+        if (mstats[i].sreqs == 0) continue;
+
+        time = mstats[i].time ? mstats[i].time : 1e-9;
+        printf("%-6s %10lu %10lu %12.3f %10.1f %12.0f\n", names[i],
+          mstats[i].sreqs, mstats[i].ops, mstats[i].bytes / 1e6,
+          mstats[i].bytes / 1e6 / time, mstats[i].ops / time);
+    }
+
+    for (i = 0; i < MAXDISKS; ++i)
+        if (fds[i] >= 0) close(fds[i]);
+
+    free((void *) iobuf);
+}
+
+/* vim: set cindent shiftwidth=4 expandtab: */
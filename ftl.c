@@ -0,0 +1,291 @@
+#include "simint.h"
+
+/* This file models the flash translation layer (FTL) of a solid-state
+ * drive beneath every disk of the array, to tell what becomes of the
+ * writes the service methods plan once they reach the flash. A drive is
+ * made of erase blocks of BLOCKPAGES pages of PAGELEN bytes, and exposes
+ * a logical capacity given in megabytes; it holds OVERPROVISION more
+ * flash than that, plus a few blocks. Logical pages are mapped to physical
+ * ones page by page. A page written goes to the next free page of the
+ * block being filled, and the page it replaces becomes invalid. When a
+ * block fills up, the next is taken from those erased, and while fewer
+ * than GCFREE are left, garbage is collected greedily: the block with the
+ * fewest valid pages has them copied to the block being filled, and is
+ * erased.
+ *
+ * Every write the plans put on a disk programs the pages it touches, a
+ * partial page costing a whole one, at offsets folded onto the logical
+ * capacity. Reads are left out, as they wear nothing. Drives start out
+ * full, written sequentially, as the steady state of a drive in service
+ * is. The report gives, per disk and for the array, the writes the disk
+ * took and the pages programmed for them, the write amplification of the
+ * FTL, the erases, and the garbage collection stalls, that is, writes
+ * held up while blocks were reclaimed, timed by PAGEREAD, PAGEPROGRAM and
+ * BLOCKERASE. The end-to-end write amplification follows: the bytes
+ * programmed per byte of RAID request written. */
+
+#define PAGELEN 4096
+#define BLOCKPAGES 256
+#define OVERPROVISION 0.07
+#define GCFREE 2
+
+/* In seconds, typical of TLC NAND. */
+#define PAGEREAD 60e-6
+#define PAGEPROGRAM 600e-6
+#define BLOCKERASE 3e-3
+
+#define NOPAGE 0xffffffffUL
+
+struct ftl {
+    unsigned long *l2p;      /* Physical page of every logical one. */
+    unsigned long *p2l;      /* Logical page of every physical one, or
+                                NOPAGE if not valid. */
+    unsigned *valid;         /* Valid pages of every block. */
+    char *erased;            /* Whether every block is erased. */
+    unsigned long *freelist; /* Erased blocks, as a stack. */
+    unsigned long freecount;
+    unsigned long active;    /* The block being filled, */
+    unsigned nextpage;       /* and its next free page. */
+    /* Pages written by the host and programmed in all, erases, and
+     * stalls, with their time. */
+    unsigned long hostpages, programmed, erases, stalls;
+    double stalltime, maxstall;
+    double bytes;            /* Bytes written to the disk. */
+};
+
+static struct ftl ftls[MAXDISKS];
+static unsigned dsks;          /* Disks seen, the most in any array. */
+static unsigned long pages;    /* Logical pages per disk. */
+static unsigned long blocks;   /* Erase blocks per disk. */
+
+/* This function gets a drive ready, full of data. */
+static void initftl(struct ftl *f)
+{
+    unsigned long block, page;
+
+    f->l2p = (unsigned long *) malloc(pages * sizeof *f->l2p);
+    f->p2l = (unsigned long *) malloc(blocks * BLOCKPAGES * sizeof
+      *f->p2l);
+    f->valid = (unsigned *) calloc(blocks, sizeof *f->valid);
+    f->erased = (char *) calloc(blocks, sizeof *f->erased);
+    f->freelist = (unsigned long *) malloc(blocks * sizeof *f->freelist);
+
+    if (f->l2p == NULL || f->p2l == NULL || f->valid == NULL || f->erased ==
+      NULL || f->freelist == NULL) {
+        fprintf(stderr, "Could not get memory for the flash "
+          "translation layer.\n");
+        exit(41);
+    }
+
+    for (page = 0; page < blocks * BLOCKPAGES; ++page)
+        f->p2l[page] = (page < pages) ? page : NOPAGE;
+    for (page = 0; page < pages; ++page) {
+        f->l2p[page] = page;
+        ++f->valid[page / BLOCKPAGES];
+    }
+
+    /* The block the data ends in is filled on; those after it are
+     * erased. */
+    f->active = pages / BLOCKPAGES;
+    f->nextpage = pages % BLOCKPAGES;
+    f->freecount = 0;
+    for (block = blocks; block > f->active + 1; --block) {
+        f->freelist[f->freecount++] = block - 1;
+        f->erased[block - 1] = 1;
+    }
+
+    f->hostpages = f->programmed = f->erases = f->stalls = 0;
+    f->stalltime = f->maxstall = 0;
+    f->bytes = 0;
+}
+
+static void program(struct ftl *f, unsigned long logical);
+
+/* This function reclaims the block with the fewest valid pages, and
+ * returns the time it took. */
+static double collect(struct ftl *f)
+{
+    unsigned long block, page, victim;
+    unsigned moved;
+
+    victim = NOPAGE;
+    for (block = 0; block < blocks; ++block)
+        if (block != f->active && !f->erased[block] && (victim == NOPAGE
+          || f->valid[block] < f->valid[victim]))
+            victim = block;
+
+    moved = 0;
+    for (page = victim * BLOCKPAGES; page < (victim + 1) * BLOCKPAGES;
+      ++page)
+        if (f->p2l[page] != NOPAGE) {
+            program(f, f->p2l[page]);
+            ++moved;
+        }
+
+    f->erased[victim] = 1;
+    f->freelist[f->freecount++] = victim;
+    ++f->erases;
+
+    return moved * (PAGEREAD + PAGEPROGRAM) + BLOCKERASE;
+}
+
+/* This function programs a logical page at the next free physical one,
+ * taking a new block if need be. */
+static void program(struct ftl *f, unsigned long logical)
+{
+    unsigned long old, physical;
+
+    if (f->nextpage == BLOCKPAGES) {
+        f->active = f->freelist[--f->freecount];
+        f->erased[f->active] = 0;
+        f->nextpage = 0;
+    }
+
+    if ((old = f->l2p[logical]) != NOPAGE) {
+        f->p2l[old] = NOPAGE;
+        --f->valid[old / BLOCKPAGES];
+    }
+
+    physical = f->active * BLOCKPAGES + f->nextpage++;
+    f->l2p[logical] = physical;
+    f->p2l[physical] = logical;
+    ++f->valid[f->active];
+    ++f->programmed;
+}
+
+/* This function writes a logical page on behalf of the host, collecting
+ * garbage first if the drive is short of erased blocks. */
+static void hostwrite(struct ftl *f, unsigned long logical)
+{
+    double stall;
+
+    stall = 0;
+    while (f->freecount < GCFREE) stall += collect(f);
+
+    if (stall > 0) {
+        ++f->stalls;
+        f->stalltime += stall;
+        if (stall > f->maxstall) f->maxstall = stall;
+    }
+
+    program(f, logical);
+    ++f->hostpages;
+}
+
+/* This function writes len bytes at offset on a disk. */
+static void diskwrite(unsigned disk, unsigned long offset, unsigned len)
+{
+    unsigned long page;
+    struct ftl *f = &ftls[disk];
+
+    f->bytes += len;
+
+    for (page = offset / PAGELEN; page <= (offset + len - 1) / PAGELEN;
+      ++page)
+        hostwrite(f, page % pages);
+}
+
+/* This function prints the report. requested is the number of bytes of
+ * RAID request written. */
+static void report(double requested)
+{
+    unsigned disk;
+    unsigned long erases, hostpages, programmed, stalls;
+    double bytes, maxstall, stalltime;
+    struct ftl *f;
+
+    printf("%-5s %10s %10s %12s %7s %9s %8s %10s %9s\n", "disk", "MB",
+      "pages", "programmed", "FTL WA", "erases", "stalls", "stall s",
+      "max ms");
+
+    bytes = maxstall = stalltime = 0;
+    erases = hostpages = programmed = stalls = 0;
+
+    for (disk = 0; disk < dsks; ++disk) {
+        f = &ftls[disk];
+
+        printf("%-5u %10.3f %10lu %12lu %7.3f %9lu %8lu %10.3f %9.3f\n",
+          disk, f->bytes / 1e6, f->hostpages, f->programmed, f->hostpages ?
+          (double) f->programmed / f->hostpages : 0, f->erases, f->stalls,
+          f->stalltime, f->maxstall * 1e3);
+
+        bytes += f->bytes;
+        hostpages += f->hostpages;
+        programmed += f->programmed;
+        erases += f->erases;
+        stalls += f->stalls;
+        stalltime += f->stalltime;
+        if (f->maxstall > maxstall) maxstall = f->maxstall;
+    }
+
+    printf("%-5s %10.3f %10lu %12lu %7.3f %9lu %8lu %10.3f %9.3f\n",
+      "all", bytes / 1e6, hostpages, programmed, hostpages ? (double)
+      programmed / hostpages : 0, erases, stalls, stalltime, maxstall *
+      1e3);
+
+    printf("\n%.3f MB of RAID requests written: array write amplification "
+      "%.3f, end-to-end %.3f; %.3f erases per block.\n", requested / 1e6,
+      requested ? bytes / requested : 0, requested ? (double) programmed *
+      PAGELEN / requested : 0, dsks ? (double) erases / (dsks * blocks) :
+      0);
+}
+
+/* This function plans every job from the source and puts the writes on
+ * drives of capacity bytes each, then prints the report. */
+void runftl(struct jobsrc *src, unsigned long capacity)
+{
+    unsigned disk;
+    unsigned long unitlen;
+    double requested;
+    struct job jb;
+    struct ioplan plan;
+    struct stripeplan *sp;
+
+    pages = capacity / PAGELEN;
+    blocks = (unsigned long) ((pages + BLOCKPAGES - 1) / BLOCKPAGES * (1 +
+      OVERPROVISION)) + GCFREE + 1;
+    dsks = 0;
+    requested = 0;
+
+    initioplan(&plan);
+    plan.model = costmodel;
+
+    while (src->next(src, &jb) == 0) {
+        if (planraidreq(&jb.array, &jb.req, &plan)) {
+            fprintf(stderr, "Could not plan the RAID request; "
+              "skipped.\n");
+            continue;
+        }
+
+        if (jb.array.datadsks + 1 > MAXDISKS) {
+            fprintf(stderr, "Too many disks to model the flash of.\n");
+            exit(42);
+        }
+        for (; dsks < jb.array.datadsks + 1; ++dsks) initftl(&ftls[dsks]);
+
+        if (jb.req.nature != WRITEREQ) continue;
+
+        requested += jb.req.len;
+        unitlen = jb.array.stripingunit;
+
+        for (sp = plan.sreqs; sp < plan.sreqs + plan.sreqcount; ++sp)
+            for (disk = 0; disk <= jb.array.datadsks; ++disk)
+                if (sp->wr[disk].len)
+                    diskwrite(disk, sp->stripe * unitlen +
+                      sp->wr[disk].offset, sp->wr[disk].len);
+    }
+
+    freeioplan(&plan);
+
+    report(requested);
+
+    for (disk = 0; disk < dsks; ++disk) {
+        free((void *) ftls[disk].l2p);
+        free((void *) ftls[disk].p2l);
+        free((void *) ftls[disk].valid);
+        free((void *) ftls[disk].erased);
+        free((void *) ftls[disk].freelist);
+    }
+}
+
+/* vim: set cindent shiftwidth=4 expandtab: */
@@ -0,0 +1,763 @@
+#include <assert.h>
+#include <limits.h>
+
+#include "reqsim.h"
+
+/* This file hosts the simulator proper, that is, the expansion of RAID
+ * requests into stripe requests and the choice of a service method for
+ * each stripe request. The outcome is an I/O plan (see reqsim.h). Nothing
+ * in here prints, and there is no static state, so the functions can be
+ * used from several threads at once as long as each thread brings its
+ * own plan. The program in reqsim.c is one user of the library. */
+
+/* Scope table: an experimental means of scalably recording stripe unit
+ * scope. When scope is recorded for groups of stripe units, we need a
+ * maximum of only 5 entries for any situation. */
+struct scopetab {
+    /* Scope of the first request unit. */
+    struct unitscope req1;
+    /* When there are two or more request units, scope of the final
+     * request unit. Otherwise, req2.len must be 0. */
+    struct unitscope req2;
+    /* When there are three or more request units, scope of units between
+     * the first request unit and the final one. Otherwise, req3.len must
+     * be 0. */
+    struct unitscope req3;
+    /* Scope of off-request stripe units, that is, data units not part of
+     * the request. */
+    struct unitscope offreq;
+    /* Scope of the parity unit. */
+    struct unitscope parity;
+};
+
+/* Everything known about the stripe request being planned. These used to
+ * be static variables, one set for the whole program. */
+struct sreqctx {
+    const struct dskarray *array; /* The current disk array. */
+    enum reqnature nature;        /* The nature of the RAID request. */
+    struct stripeplan *plan;      /* The current stripe request. */
+    /* A relative number indicating the first and final stripe units of
+     * the request. */
+    unsigned firstunit, finalunit;
+    /* The number of stripe units in the stripe request. Only data units
+     * are counted. */
+    unsigned requnits;
+    /* Physical stripe number. In single-level RAID configurations, the
+     * physical number is the same as a stripe's logical number. */
+    unsigned stripe;
+    /* The fault (flt) status (stat) of the current stripe (s). A value of
+     * FLTFREE means the stripe is fault-free. Any other value indicates
+     * that one the stripe's units falls on a faulty disk. If the value
+     * equals PARITY_UNIT, then it is the parity unit. Otherwise, the the
+     * value is the number of the unfortunate data unit.*/
+    int fltstats;
+    /* The cost model writes are planned by, if any, and what it has made
+     * of them so far (see struct ioplan). */
+    const struct devmodel *model;
+    unsigned overruled;
+    double saved;
+    /* The reconstructed-unit cache, if any, and what it has saved so far
+     * (see struct ioplan). */
+    struct rrcache *cache;
+    unsigned rrhits, rrsaved;
+    /* The known-zero map, if any, and what it has saved so far (see
+     * struct ioplan). */
+    struct zeromap *zeros;
+    unsigned zerohits, zerosaved;
+};
+
+#define PARITY_UNIT -2
+
+const struct devmodel hddmodel = {8e-3, 150e6, 1, 8};
+const struct devmodel ssdmodel = {60e-6, 500e6, 8, 8};
+
+/* This function expands a RAID request to one or more stripe requests,
+ * storing the offset and length of each in the plan. The number of stripe
+ * requests is returned. */
+static unsigned expandraidreq(const struct dskarray *array, const struct
+  raidreq *rreq, struct stripeplan *reqs)
+{
+    unsigned extlen, nextoffset, reqcount, stripelen;
+    struct stripeplan *req;
+
+    /* We are interested in the stripe length without the parity unit, in
+     * other words, the length of the logical stripe. */
+    stripelen = array->datadsks * array->stripingunit;
+
+    /* Extended length: RAID request length + the stripe-relative offset.
+     * This limits alignment uncertainty to one end of the request without
+     * affecting the number of stripe requests. */
+    extlen = rreq->len + rreq->offset % stripelen;
+    reqcount = extlen / stripelen;
+    if (extlen - reqcount * stripelen) ++reqcount;
+
+    if (reqs == NULL) return reqcount;
+
+    req = reqs;
+
+    /* The first stripe request. */
+    req->offset = rreq->offset;
+    req->len = (reqcount == 1) ? rreq->len : stripelen - rreq->offset %
+      stripelen;
+
+    if (reqcount > 1) {
+        nextoffset = req->offset + req->len;
+
+        /* Stripe requests between the first and the last, if there are
+         * any. */
+        for (++req; req < reqs + reqcount - 1; ++req) {
+            req->offset = nextoffset;
+            req->len = stripelen;
+            nextoffset += stripelen;
+        }
+
+        /* The last stripe request. */
+        req->offset = nextoffset;
+        req->len = rreq->len - reqs->len - (reqcount - 2) * stripelen;
+    }
+
+    return reqcount;
+}
+
+/* This function widens a scope to take in len bytes at offset. As a
+ * scope is a single stretch, anything in between is taken in too. */
+static void widenscope(struct unitscope *scope, unsigned offset, unsigned
+  len)
+{
+    unsigned end;
+
+    if (scope->len == 0) {
+        scope->offset = offset;
+        scope->len = len;
+        return;
+    }
+
+    end = scope->offset + scope->len;
+    if (offset + len > end) end = offset + len;
+    if (offset < scope->offset) scope->offset = offset;
+    scope->len = end - scope->offset;
+}
+
+/* Functions the planner calls which work the same whatever the geometry,
+ * and thus are common to all kernels. */
+static enum svcmethod costwrite(struct sreqctx *c, struct scopetab
+  *inscopes, struct scopetab *outscopes, enum svcmethod method);
+static int rrfromcache(struct sreqctx *c, struct scopetab *inscopes,
+  struct scopetab *outscopes);
+static void rrkeep(struct sreqctx *c, struct scopetab *inscopes);
+static void rrforget(struct sreqctx *c, struct scopetab *inscopes);
+static unsigned zeroreads(struct sreqctx *c);
+static void zerowritten(struct sreqctx *c);
+static void zerodiscarded(struct sreqctx *c);
+
+/* The generic kernel, which the common functions use too. */
+#define K(name) name
+#define LEVEL (c->array->lvl)
+#define DATADSKS (c->array->datadsks)
+#define UNITLEN (c->array->stripingunit)
+#define SECTORLEN ARRAYSECTOR(c->array)
+#include "plankern.h"
+
+/* This function tells whether a scope table reads anything from the
+ * faulty unit of the stripe. */
+static int readsfaulty(struct sreqctx *c, struct scopetab *scopes)
+{
+    if (c->fltstats == FLTFREE)
+        return 0;
+    else if (c->fltstats == PARITY_UNIT)
+        return scopes->parity.len != 0;
+    else if (c->fltstats == (int) c->firstunit)
+        return scopes->req1.len != 0;
+    else if (c->fltstats == (int) c->finalunit)
+        return scopes->req2.len != 0;
+    else if (c->fltstats > (int) c->firstunit && c->fltstats < (int)
+      c->finalunit)
+        return scopes->req3.len != 0;
+    else
+        return scopes->offreq.len != 0;
+}
+
+/* This function weighs the service methods able to serve a write stripe
+ * request by the time the cost model expects each to take, and replaces
+ * the method processwrite chose with the fastest. A method is able if it
+ * reads nothing from the faulty unit; reconstruct-write-plus, which
+ * assumes the faulty unit is the first or final of two or more request
+ * units, is not considered otherwise. Ties go to processwrite. The
+ * stripe request's writes must be planned already, as they count too;
+ * its reads are used as scratch. */
+static enum svcmethod costwrite(struct sreqctx *c, struct scopetab
+  *inscopes, struct scopetab *outscopes, enum svcmethod method)
+{
+    static const enum svcmethod methods[] = {RMWMETHOD, RWMETHOD,
+      RWPLUSMETHOD};
+    unsigned i;
+    double best, chosen, time;
+    enum svcmethod fastest;
+    struct scopetab fastscopes, scopes;
+
+    if (method == NWMETHOD) return method;
+
+    scopestodisks(c, outscopes, c->plan->rd);
+    chosen = best = plantime(c->model, c->array, c->plan);
+    fastest = method;
+
+    for (i = 0; i < sizeof methods / sizeof methods[0]; ++i) {
+        if (methods[i] == method)
+            continue;
+        else if (methods[i] == RMWMETHOD)
+            rmwmethod(c, inscopes, &scopes);
+        else if (methods[i] == RWMETHOD)
+            rwmethod(c, inscopes, &scopes);
+        else if (c->requnits > 1 && (c->fltstats == (int) c->firstunit ||
+          c->fltstats == (int) c->finalunit))
+            rwplusmethod(c, inscopes, &scopes);
+        else
+            continue;
+
+        if (readsfaulty(c, &scopes)) continue;
+
+        scopestodisks(c, &scopes, c->plan->rd);
+        if ((time = plantime(c->model, c->array, c->plan)) < best) {
+            best = time;
+            fastest = methods[i];
+            fastscopes = scopes;
+        }
+    }
+
+    if (fastest != method) {
+        *outscopes = fastscopes;
+        ++c->overruled;
+        c->saved += chosen - best;
+    }
+
+    return fastest;
+}
+
+/* Reconstructed-unit cache: what is known of the faulty unit of recently
+ * reconstructed stripes, one stretch per stripe, in a direct-mapped table.
+ * The contents are those of the array the cache was last used with. */
+struct rrentry {
+    unsigned stripe;
+    struct unitscope scope; /* Nothing is known if the length is 0. */
+};
+
+struct rrcache {
+    struct dskarray array;
+    unsigned entries;
+    struct rrentry *entry;
+};
+
+struct rrcache *newrrcache(unsigned entries)
+{
+    struct rrcache *cache;
+
+    if (entries == 0 || (cache = (struct rrcache *) malloc(sizeof *cache))
+      == NULL)
+        return NULL;
+
+    if ((cache->entry = (struct rrentry *) calloc(entries, sizeof
+      *cache->entry)) == NULL) {
+        free((void *) cache);
+        return NULL;
+    }
+
+    /* No array has no data disks, so the first use empties the cache. */
+    memset(&cache->array, 0, sizeof cache->array);
+    cache->entries = entries;
+
+    return cache;
+}
+
+void freerrcache(struct rrcache *cache)
+{
+    if (cache == NULL) return;
+
+    free((void *) cache->entry);
+    free((void *) cache);
+}
+
+/* This function empties the cache if it was last used with an array other
+ * than the given one. */
+static void checkrrcache(struct rrcache *cache, const struct dskarray
+  *array)
+{
+    if (memcmp(&cache->array, array, sizeof *array) == 0) return;
+
+    memset(cache->entry, 0, cache->entries * sizeof *cache->entry);
+    cache->array = *array;
+}
+
+/* This function serves a read stripe request whose faulty unit is cached
+ * by reading the other request units directly, as if under direct-read.
+ * Nonzero is returned if the cache could do so, and the bytes of
+ * reconstruct-read so saved are accounted for. */
+static int rrfromcache(struct sreqctx *c, struct scopetab *inscopes,
+  struct scopetab *outscopes)
+{
+    unsigned rrbytes;
+    struct rrentry *e = &c->cache->entry[c->stripe % c->cache->entries];
+    struct scopetab scratch;
+    struct unitscope fltscope;
+
+    fltscope = faultyscope(c, inscopes);
+
+    if (e->scope.len == 0 || e->stripe != c->stripe || fltscope.offset <
+      e->scope.offset || fltscope.offset + fltscope.len > e->scope.offset +
+      e->scope.len)
+        return 0;
+
+    rrbytes = rrmethod(c, inscopes, &scratch);
+
+    /* A faulty unit among req3 is left out by scopestodisks. */
+    *outscopes = *inscopes;
+    if (c->fltstats == (int) c->firstunit)
+        outscopes->req1.len = 0;
+    else if (c->fltstats == (int) c->finalunit)
+        outscopes->req2.len = 0;
+
+    ++c->rrhits;
+    c->rrsaved += rrbytes - scopebytes(c, outscopes);
+
+    return 1;
+}
+
+/* This function records that the faulty unit's scope has just been
+ * reconstructed. What is known of the stripe grows if the two stretches
+ * meet, and is replaced otherwise, as is any other stripe's. */
+static void rrkeep(struct sreqctx *c, struct scopetab *inscopes)
+{
+    struct rrentry *e = &c->cache->entry[c->stripe % c->cache->entries];
+    struct unitscope fltscope;
+
+    fltscope = faultyscope(c, inscopes);
+
+    if (e->scope.len && e->stripe == c->stripe && fltscope.offset <=
+      e->scope.offset + e->scope.len && e->scope.offset <= fltscope.offset +
+      fltscope.len)
+        widenscope(&e->scope, fltscope.offset, fltscope.len);
+    else {
+        e->stripe = c->stripe;
+        e->scope = fltscope;
+    }
+}
+
+/* This function forgets what is known of the faulty unit of the stripe
+ * if a write stripe request changes any of it. Writes to other units
+ * leave it as it was. */
+static void rrforget(struct sreqctx *c, struct scopetab *inscopes)
+{
+    struct rrentry *e = &c->cache->entry[c->stripe % c->cache->entries];
+    struct unitscope fltscope;
+
+    if (c->fltstats < (int) c->firstunit || c->fltstats > (int)
+      c->finalunit || e->scope.len == 0 || e->stripe != c->stripe)
+        return;
+
+    fltscope = faultyscope(c, inscopes);
+
+    if (fltscope.offset < e->scope.offset + e->scope.len &&
+      e->scope.offset < fltscope.offset + fltscope.len)
+        e->scope.len = 0;
+}
+
+/* Known-zero map: one bit per data unit, in logical order, that is, by
+ * offset in the array, set if the unit is known to hold zeros. Units
+ * beyond the map are not. The contents are those of the array the map was
+ * last used with. */
+struct zeromap {
+    struct dskarray array;
+    unsigned units;
+    unsigned long *bits;
+};
+
+#define ZEROBITS (8 * sizeof (unsigned long))
+#define ISZERO(zeros, unit) ((unit) < (zeros)->units && \
+  (zeros)->bits[(unit) / ZEROBITS] >> (unit) % ZEROBITS & 1)
+
+struct zeromap *newzeromap(unsigned units)
+{
+    struct zeromap *zeros;
+
+    if (units == 0 || (zeros = (struct zeromap *) malloc(sizeof *zeros)) ==
+      NULL)
+        return NULL;
+
+    if ((zeros->bits = (unsigned long *) malloc((units + ZEROBITS - 1) /
+      ZEROBITS * sizeof *zeros->bits)) == NULL) {
+        free((void *) zeros);
+        return NULL;
+    }
+
+    /* No array has no data disks, so the first use fills the map. */
+    memset(&zeros->array, 0, sizeof zeros->array);
+    zeros->units = units;
+
+    return zeros;
+}
+
+void freezeromap(struct zeromap *zeros)
+{
+    if (zeros == NULL) return;
+
+    free((void *) zeros->bits);
+    free((void *) zeros);
+}
+
+/* This function marks every unit zero if the map was last used with an
+ * array of another layout. A disk failing, or being replaced, leaves the
+ * data as it was, so the fault status does not count. */
+static void checkzeromap(struct zeromap *zeros, const struct dskarray
+  *array)
+{
+    if (zeros->array.lvl == array->lvl && zeros->array.datadsks ==
+      array->datadsks && zeros->array.stripingunit == array->stripingunit
+      && ARRAYSECTOR(&zeros->array) == ARRAYSECTOR(array))
+        return;
+
+    memset(zeros->bits, 0xff, (zeros->units + ZEROBITS - 1) / ZEROBITS *
+      sizeof *zeros->bits);
+    zeros->array = *array;
+}
+
+/* This function drops the reads of the stripe request from data units
+ * known to be zero, and from the parity unit if all the data units are,
+ * accounting for the bytes so saved. The new number of bytes read is
+ * returned. */
+static unsigned zeroreads(struct sreqctx *c)
+{
+    unsigned allzero, bytes, disk, first, saved, unit;
+    struct stripeplan *plan = c->plan;
+
+    first = c->stripe * c->array->datadsks;
+
+    for (unit = 0; unit < c->array->datadsks && ISZERO(c->zeros, first +
+      unit); ++unit);
+    allzero = unit == c->array->datadsks;
+
+    bytes = saved = 0;
+
+    for (disk = 0; disk <= c->array->datadsks; ++disk) {
+        unit = disktounit(c, disk);
+        if (plan->rd[disk].len && (unit == c->array->datadsks ? allzero :
+          ISZERO(c->zeros, first + unit))) {
+            saved += plan->rd[disk].len;
+            plan->rd[disk].offset = plan->rd[disk].len = 0;
+        }
+        bytes += plan->rd[disk].len;
+    }
+
+    if (saved) {
+        ++c->zerohits;
+        c->zerosaved += saved;
+    }
+
+    return bytes;
+}
+
+/* This function records that the request units of a write stripe request
+ * are no longer known to be zero. */
+static void zerowritten(struct sreqctx *c)
+{
+    unsigned unit;
+
+    for (unit = c->stripe * c->array->datadsks + c->firstunit; unit <=
+      c->stripe * c->array->datadsks + c->finalunit && unit <
+      c->zeros->units; ++unit)
+        c->zeros->bits[unit / ZEROBITS] &= ~(1UL << unit % ZEROBITS);
+}
+
+/* This function records that the data units of a stripe discarded whole
+ * are zero. */
+static void zerodiscarded(struct sreqctx *c)
+{
+    unsigned unit;
+
+    if (c->plan->len != c->array->datadsks * c->array->stripingunit)
+        return;
+
+    for (unit = c->stripe * c->array->datadsks; unit < (c->stripe + 1) *
+      c->array->datadsks && unit < c->zeros->units; ++unit)
+        c->zeros->bits[unit / ZEROBITS] |= 1UL << unit % ZEROBITS;
+}
+
+/* Kernels of their own for the geometries in GEOMETRIES (see Makefile),
+ * and a table to find them by, ending with the generic kernel. */
+struct kernel {
+    enum raidlvl lvl;
+    unsigned datadsks, stripingunit, sector;
+    void (*processreq)(struct sreqctx *c);
+};
+
+#include "kernels.h"
+
+static const struct kernel kernels[] = {KERNELS {RAID5, 0, 0, 0,
+  processreq}};
+
+/* This function returns the kernel for the array's geometry. */
+static const struct kernel *findkernel(const struct dskarray *array)
+{
+    const struct kernel *k;
+
+    for (k = kernels; k->datadsks; ++k)
+        if (k->lvl == array->lvl && k->datadsks == array->datadsks &&
+          k->stripingunit == array->stripingunit && k->sector ==
+          ARRAYSECTOR(array))
+            break;
+
+    return k;
+}
+
+/* This function tells whether the library can deal with the given array
+ * and RAID request. Offsets are 32 bits wide, so the stripe length must
+ * fit in them, and so must the end of the request, rounded up to a whole
+ * sector. secshift is what sectorshift returns for the array. */
+static int validjob(const struct dskarray *array, const struct raidreq
+  *rreq, unsigned secshift)
+{
+    unsigned sector = ARRAYSECTOR(array);
+
+    return array->datadsks >= 2 && array->stripingunit &&
+      array->stripingunit <= UINT_MAX / array->datadsks &&
+      SECTOROFF(array->stripingunit, sector, secshift) == 0 &&
+      (array->fltstata == FLTFREE || array->fltstata >= 0 &&
+      array->fltstata <= (int) array->datadsks) && (rreq == NULL ||
+      rreq->len && rreq->len <= UINT_MAX - rreq->offset && rreq->offset +
+      rreq->len <= UINT_MAX - SECTOROFF(UINT_MAX, sector, secshift));
+}
+
+unsigned sectorshift(const struct dskarray *array)
+{
+    unsigned sector, shift;
+
+    switch (sector = ARRAYSECTOR(array)) {
+    case 512:  /* 512-byte and 512e drives. */
+        return 9;
+    case 4096: /* 4Kn drives. */
+        return 12;
+    }
+
+    for (shift = 0; (1U << shift) < sector; ++shift);
+
+    return ((1U << shift) == sector) ? shift : 0;
+}
+
+double disktime(const struct devmodel *model, unsigned ops, double bytes)
+{
+    return (ops + model->queues - 1) / model->queues * model->opcost +
+      bytes / model->bandwidth;
+}
+
+double plantime(const struct devmodel *model, const struct dskarray *array,
+  const struct stripeplan *plan)
+{
+    unsigned disk;
+    double busy, rd, time, wr;
+
+    busy = rd = wr = 0;
+
+    for (disk = 0; disk <= array->datadsks; ++disk) {
+        if (plan->rd[disk].len) {
+            if ((time = disktime(model, 1, plan->rd[disk].len)) > rd)
+                rd = time;
+            busy += model->opcost / model->queues + plan->rd[disk].len /
+              model->bandwidth;
+        }
+        if (plan->wr[disk].len) {
+            if ((time = disktime(model, 1, plan->wr[disk].len)) > wr)
+                wr = time;
+            busy += model->opcost / model->queues + plan->wr[disk].len /
+              model->bandwidth;
+        }
+    }
+
+    /* With inflight stripe requests like this one spread evenly over the
+     * disks, every disk has inflight times its share of this one's work
+     * to do. */
+    busy *= (double) model->inflight / (array->datadsks + 1);
+
+    return (rd + wr > busy) ? rd + wr : busy;
+}
+
+int planstripereq(const struct dskarray *array, enum reqnature nature,
+  struct stripeplan *plan)
+{
+    unsigned sector, secshift, stripelen;
+    struct sreqctx c;
+
+    sector = ARRAYSECTOR(array);
+    secshift = sectorshift(array);
+    stripelen = array->datadsks * array->stripingunit;
+
+    if (!validjob(array, NULL, secshift) || plan->len == 0 ||
+      SECTOROFF(plan->offset, sector, secshift) || SECTOROFF(plan->len,
+      sector, secshift) || plan->offset % stripelen + plan->len >
+      stripelen)
+        return -1;
+
+    c.array = array;
+    c.nature = nature;
+    c.plan = plan;
+    c.model = NULL;
+    c.cache = NULL;
+    c.zeros = NULL;
+
+    plan->partial = 0;
+    findkernel(array)->processreq(&c);
+
+    return 0;
+}
+
+void initioplan(struct ioplan *plan)
+{
+    plan->sreqcount = 0;
+    plan->sreqs = NULL;
+    plan->rdbytes = plan->wrbytes = plan->rdops = plan->wrops = 0;
+    plan->partials = 0;
+    plan->model = NULL;
+    plan->overruled = 0;
+    plan->saved = 0;
+    plan->cache = NULL;
+    plan->rrhits = plan->rrsaved = 0;
+    plan->zeros = NULL;
+    plan->zerohits = plan->zerosaved = 0;
+    plan->generic = 0;
+    plan->sreqcap = 0;
+    plan->scopecap = 0;
+    plan->scopes = NULL;
+}
+
+void freeioplan(struct ioplan *plan)
+{
+    free((void *) plan->sreqs);
+    free((void *) plan->scopes);
+
+    initioplan(plan);
+}
+
+int expandioplan(const struct dskarray *array, const struct raidreq *rreq,
+  struct ioplan *plan)
+{
+    unsigned dsks, end, head, reqcount, sector, secshift, tail;
+    void *mem;
+    struct raidreq wide; /* The request widened to whole sectors. */
+    struct stripeplan *sp;
+
+    sector = ARRAYSECTOR(array);
+    secshift = sectorshift(array);
+
+    if (!validjob(array, rreq, secshift)) return -1;
+
+    /* How far into their sectors the request begins and ends. */
+    end = rreq->offset + rreq->len;
+    head = SECTOROFF(rreq->offset, sector, secshift);
+    tail = SECTOROFF(end, sector, secshift);
+
+    wide = *rreq;
+    wide.offset -= head;
+    wide.len = end + (tail ? sector - tail : 0) - wide.offset;
+
+    dsks = array->datadsks + 1;
+    reqcount = expandraidreq(array, &wide, NULL);
+
+    /* Storage is kept from one call to the next and only ever grows, so
+     * that planning at a high rate does not mean allocating at a high
+     * rate. */
+    if (reqcount > plan->sreqcap) {
+        if ((mem = realloc((void *) plan->sreqs, reqcount * sizeof
+          *plan->sreqs)) == NULL)
+            return -1;
+        plan->sreqs = (struct stripeplan *) mem;
+        plan->sreqcap = reqcount;
+    }
+
+    if (2 * dsks * reqcount > plan->scopecap) {
+        if ((mem = realloc((void *) plan->scopes, 2 * dsks * reqcount *
+          sizeof *plan->scopes)) == NULL)
+            return -1;
+        plan->scopes = (struct unitscope *) mem;
+        plan->scopecap = 2 * dsks * reqcount;
+    }
+
+    plan->sreqcount = expandraidreq(array, &wide, plan->sreqs);
+    plan->rdbytes = plan->wrbytes = plan->rdops = plan->wrops = 0;
+    plan->partials = 0;
+    plan->overruled = 0;
+    plan->saved = 0;
+    plan->rrhits = plan->rrsaved = 0;
+    plan->zerohits = plan->zerosaved = 0;
+
+    for (sp = plan->sreqs; sp < plan->sreqs + plan->sreqcount; ++sp) {
+        sp->rd = plan->scopes + 2 * dsks * (sp - plan->sreqs);
+        sp->wr = sp->rd + dsks;
+        sp->partial = 0;
+    }
+
+    /* Partly written sectors, found at either end of the request. When
+     * the request begins and ends partway through the same sector, that
+     * sector is counted once, as the first. */
+    if (rreq->nature == WRITEREQ) {
+        if (head) {
+            plan->sreqs->partial |= 1;
+            ++plan->partials;
+        }
+        if (tail && !(head && wide.len == sector)) {
+            plan->sreqs[plan->sreqcount - 1].partial |= 2;
+            ++plan->partials;
+        }
+    }
+
+    return 0;
+}
+
+void planioplan(const struct dskarray *array, enum reqnature nature,
+  struct ioplan *plan)
+{
+    void (*process)(struct sreqctx *c);
+    struct stripeplan *sp;
+    struct sreqctx c;
+
+    /* The kernel is chosen once for all the stripe requests. */
+    process = plan->generic ? processreq : findkernel(array)->processreq;
+
+    c.array = array;
+    c.nature = nature;
+    c.model = plan->model;
+    c.overruled = 0;
+    c.saved = 0;
+    c.cache = plan->cache;
+    c.rrhits = c.rrsaved = 0;
+    c.zeros = plan->zeros;
+    c.zerohits = c.zerosaved = 0;
+
+    if (c.cache) checkrrcache(c.cache, array);
+    if (c.zeros) checkzeromap(c.zeros, array);
+
+    for (sp = plan->sreqs; sp < plan->sreqs + plan->sreqcount; ++sp) {
+        c.plan = sp;
+        process(&c);
+
+        plan->rdbytes += sp->rdbytes;
+        plan->wrbytes += sp->wrbytes;
+        plan->rdops += sp->rdops;
+        plan->wrops += sp->wrops;
+    }
+
+    plan->overruled += c.overruled;
+    plan->saved += c.saved;
+    plan->rrhits += c.rrhits;
+    plan->rrsaved += c.rrsaved;
+    plan->zerohits += c.zerohits;
+    plan->zerosaved += c.zerosaved;
+}
+
+int planraidreq(const struct dskarray *array, const struct raidreq *rreq,
+  struct ioplan *plan)
+{
+    if (expandioplan(array, rreq, plan)) return -1;
+
+    planioplan(array, rreq->nature, plan);
+
+    return 0;
+}
+
+/* vim: set cindent shiftwidth=4 expandtab: */
@@ -0,0 +1,260 @@
+#include "simint.h"
+
+/* This file keeps account of the load a trace puts on every disk of the
+ * array: operations and bytes, read and written, as planned. Load is
+ * bucketed two ways, by region of the disks, that is, by where on a disk
+ * it falls, and by window, that is, by when it arrives: by arrival time
+ * from the first job on if the trace carries timestamps, and counted in
+ * jobs otherwise. There is a fixed number of buckets of either kind; when
+ * a region or window falls beyond the last bucket, the buckets are merged
+ * in pairs and made twice as long, so a trace of any length and reach ends
+ * up spread over at least half of them.
+ *
+ * The report flags load above a given share of a whole with '*': a disk
+ * with more than that share of the array's load, a region or window with
+ * more than that share of the trace's, and, within a region or window, a
+ * disk with more than that share of it. Shares of operations and of bytes
+ * are both looked at. A parity disk in a RAID4 array taking writes, or a
+ * workload hammering a few stripes, shows up as a fair share of 1 in
+ * datadsks + 1 would not. */
+
+#define BUCKETS 16
+
+struct load {
+    unsigned long rdops, wrops;
+    double rdbytes, wrbytes;
+};
+
+static struct load total[MAXDISKS];
+static struct load regions[BUCKETS][MAXDISKS];
+static struct load windows[BUCKETS][MAXDISKS];
+static struct load timewindows[BUCKETS][MAXDISKS];
+static unsigned long regionlen; /* Bytes of a disk per region. */
+static unsigned long windowlen; /* Jobs per window. */
+static unsigned long timelen;   /* Microseconds per time window. */
+static unsigned dsks;           /* Disks seen, the most in any array. */
+static int timed;               /* Whether any job has a timestamp. */
+
+/* This function merges buckets in pairs, leaving the upper half empty. */
+static void fold(struct load buckets[BUCKETS][MAXDISKS])
+{
+    unsigned bucket, disk;
+    struct load *lo, *hi;
+
+    for (bucket = 0; bucket < BUCKETS / 2; ++bucket)
+        for (disk = 0; disk < MAXDISKS; ++disk) {
+            lo = &buckets[2 * bucket][disk];
+            hi = &buckets[2 * bucket + 1][disk];
+            buckets[bucket][disk].rdops = lo->rdops + hi->rdops;
+            buckets[bucket][disk].wrops = lo->wrops + hi->wrops;
+            buckets[bucket][disk].rdbytes = lo->rdbytes + hi->rdbytes;
+            buckets[bucket][disk].wrbytes = lo->wrbytes + hi->wrbytes;
+        }
+
+    memset(buckets[BUCKETS / 2], 0, BUCKETS / 2 * sizeof *buckets);
+}
+
+static void add(struct load *l, int write, unsigned bytes)
+{
+    if (write) {
+        ++l->wrops;
+        l->wrbytes += bytes;
+    }
+    else {
+        ++l->rdops;
+        l->rdbytes += bytes;
+    }
+}
+
+/* This function accounts for one operation on a disk, at the given offset
+ * from its start, made for the given job, arriving time microseconds
+ * after the first. */
+static void account(unsigned disk, int write, unsigned long offset,
+  unsigned len, unsigned long job, unsigned long time)
+{
+    while (offset / regionlen >= BUCKETS) {
+        fold(regions);
+        regionlen *= 2;
+    }
+
+    while (job / windowlen >= BUCKETS) {
+        fold(windows);
+        windowlen *= 2;
+    }
+
+    while (time / timelen >= BUCKETS) {
+        fold(timewindows);
+        timelen *= 2;
+    }
+
+    add(&total[disk], write, len);
+    add(&regions[offset / regionlen][disk], write, len);
+    add(&windows[job / windowlen][disk], write, len);
+    add(&timewindows[time / timelen][disk], write, len);
+}
+
+static unsigned long ops(const struct load *l)
+{
+    return l->rdops + l->wrops;
+}
+
+static double bytes(const struct load *l)
+{
+    return l->rdbytes + l->wrbytes;
+}
+
+/* This function tells whether part is above share of whole, by operations
+ * or by bytes. */
+static int hot(const struct load *part, const struct load *whole, double
+  share)
+{
+    return ops(part) > share * ops(whole) || bytes(part) > share *
+      bytes(whole);
+}
+
+/* This function prints a row of buckets: its label, its total load, and
+ * the operations on every disk. */
+static void printbucket(const char *label, struct load *row, const struct
+  load *sum, double share)
+{
+    struct load rowsum;
+    unsigned disk;
+
+    memset(&rowsum, 0, sizeof rowsum);
+    for (disk = 0; disk < dsks; ++disk) {
+        rowsum.rdops += row[disk].rdops;
+        rowsum.wrops += row[disk].wrops;
+        rowsum.rdbytes += row[disk].rdbytes;
+        rowsum.wrbytes += row[disk].wrbytes;
+    }
+
+    printf("%-23s%c %10lu %10.3f", label, hot(&rowsum, sum, share) ? '*' :
+      ' ', ops(&rowsum), bytes(&rowsum) / 1e6);
+
+    for (disk = 0; disk < dsks; ++disk)
+        printf(" %9lu%c", ops(&row[disk]), hot(&row[disk], &rowsum, share)
+          ? '*' : ' ');
+
+    putchar('\n');
+}
+
+static void printheader(const char *label)
+{
+    unsigned disk;
+
+    printf("%-24s %10s %10s", label, "ops", "MB");
+    for (disk = 0; disk < dsks; ++disk) printf("    disk%-2u ", disk);
+    putchar('\n');
+}
+
+/* This function prints the report. share is a fraction. */
+static void report(double share)
+{
+    char label[64];
+    unsigned bucket, disk;
+    struct load sum;
+
+    memset(&sum, 0, sizeof sum);
+    for (disk = 0; disk < dsks; ++disk) {
+        sum.rdops += total[disk].rdops;
+        sum.wrops += total[disk].wrops;
+        sum.rdbytes += total[disk].rdbytes;
+        sum.wrbytes += total[disk].wrbytes;
+    }
+
+    printf("%-5s %10s %10s %12s %12s %7s %7s\n", "disk", "rd ops", "wr ops",
+      "rd MB", "wr MB", "ops %", "bytes %");
+
+    for (disk = 0; disk < dsks; ++disk)
+        printf("%-4u%c %10lu %10lu %12.3f %12.3f %7.1f %7.1f\n", disk,
+          hot(&total[disk], &sum, share) ? '*' : ' ', total[disk].rdops,
+          total[disk].wrops, total[disk].rdbytes / 1e6, total[disk].wrbytes
+          / 1e6, ops(&sum) ? 100.0 * ops(&total[disk]) / ops(&sum) : 0,
+          bytes(&sum) ? 100 * bytes(&total[disk]) / bytes(&sum) : 0);
+
+    putchar('\n');
+    printheader("region");
+    for (bucket = 0; bucket < BUCKETS; ++bucket) {
+        sprintf(label, "%luK-%luK", bucket * (regionlen / 1024), (bucket +
+          1) * (regionlen / 1024));
+        printbucket(label, regions[bucket], &sum, share);
+    }
+
+    putchar('\n');
+    if (timed) {
+        printheader("window (s)");
+        for (bucket = 0; bucket < BUCKETS; ++bucket) {
+            sprintf(label, "%.3f-%.3f", bucket * (timelen / 1e6), (bucket +
+              1) * (timelen / 1e6));
+            printbucket(label, timewindows[bucket], &sum, share);
+        }
+        return;
+    }
+
+    printheader("window (jobs)");
+    for (bucket = 0; bucket < BUCKETS; ++bucket) {
+        sprintf(label, "%lu-%lu", bucket * windowlen, (bucket + 1) *
+          windowlen - 1);
+        printbucket(label, windows[bucket], &sum, share);
+    }
+}
+
+/* This function plans every job from the source and accounts for the
+ * load, then prints the report. Load above percent per cent of a whole is
+ * flagged. */
+void runload(struct jobsrc *src, double percent)
+{
+    unsigned disk;
+    unsigned long first, job, time, unitlen;
+    struct job jb;
+    struct ioplan plan;
+    struct stripeplan *sp;
+
+    regionlen = 65536;
+    windowlen = 1;
+    timelen = 1000;
+    dsks = 0;
+    timed = 0;
+    first = 0;
+
+    initioplan(&plan);
+    plan.model = costmodel;
+
+    for (job = 0; src->next(src, &jb) == 0; ++job) {
+        if (planraidreq(&jb.array, &jb.req, &plan)) {
+            fprintf(stderr, "Could not plan the RAID request; "
+              "skipped.\n");
+            continue;
+        }
+
+        if (jb.array.datadsks + 1 > MAXDISKS) {
+            fprintf(stderr, "Too many disks to keep account of.\n");
+            exit(21);
+        }
+        if (jb.array.datadsks + 1 > dsks) dsks = jb.array.datadsks + 1;
+
+        unitlen = jb.array.stripingunit;
+
+        /* Time counts from the first job; a job without a timestamp, or
+         * arriving out of order, goes in the first window. */
+        if (job == 0) first = jb.req.time;
+        if (jb.req.time) timed = 1;
+        time = (jb.req.time > first) ? jb.req.time - first : 0;
+
+        for (sp = plan.sreqs; sp < plan.sreqs + plan.sreqcount; ++sp)
+            for (disk = 0; disk <= jb.array.datadsks; ++disk) {
+                if (sp->rd[disk].len)
+                    account(disk, 0, sp->stripe * unitlen +
+                      sp->rd[disk].offset, sp->rd[disk].len, job, time);
+                if (sp->wr[disk].len)
+                    account(disk, 1, sp->stripe * unitlen +
+                      sp->wr[disk].offset, sp->wr[disk].len, job, time);
+            }
+    }
+
+    freeioplan(&plan);
+
+    report(percent / 100);
+}
+
+/* vim: set cindent shiftwidth=4 expandtab: */
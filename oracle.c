@@ -0,0 +1,364 @@
+/* Threads are a POSIX matter. */
+#define _POSIX_C_SOURCE 200112L
+
+#include <pthread.h>
+
+#include "reqsim.h"
+
+/* This file checks the service methods the library chooses against a
+ * model of what a stripe request needs to read, sector by sector. Stripe
+ * requests are enumerated exhaustively for every geometry of 2 to
+ * MAXDATADSKS data disks and striping units of 1 to MAXUNITSECTORS
+ * sectors, every fault status, and both natures, and planned with
+ * planstripereq, that is, by bytes read rather than by a cost model.
+ * Geometries are shared out among a number of threads.
+ *
+ * The model takes the sectors at the same place in every unit of the
+ * stripe, a row, one at a time. A row a write leaves alone needs nothing
+ * read, nor does any row when the parity unit is faulty. Otherwise, new
+ * parity for the row comes either from the old contents of the sectors
+ * written and of parity (as under read-modify-write) or from the sectors
+ * of the row not written (as under reconstruct-write); when a data unit
+ * is faulty, its sector in the row can be read under neither, so a row
+ * which writes it needs the sectors not written, and a row which does not
+ * needs the sectors written and parity, or every other sector to rebuild
+ * it. A read needs the sectors requested or, for a row whose requested
+ * sector is faulty, every other sector of the row. Two bounds follow. The
+ * minimum is the sum, over rows, of the fewest sectors a row can do with.
+ * The floor is the fewest sectors any plan of the library's form can
+ * read, that is, with a single stretch per disk, found by trying every
+ * way of choosing for the rows which have a choice. The floor is never
+ * below the minimum, as a stretch takes in whatever lies between.
+ *
+ * A stripe request reading more than the floor is a case where the
+ * library could have read less; every one is printed,
+ *
+ *     DATADSKS UNIT FAULT NATURE OFFSET LENGTH METHOD READ FLOOR MINIMUM
+ *
+ * with lengths in sectors, READ being what the library reads. A plan
+ * which reads the faulty disk, or too little to carry out the request, is
+ * printed with ERROR in front. A summary by service method closes the
+ * report: stripe requests, those above the floor, the bytes read, and
+ * the bytes read above the floor and above the minimum. */
+
+#define MAXDATADSKS 8
+#define MAXUNITSECTORS 8
+
+#define GEOMETRIES ((MAXDATADSKS - 1) * MAXUNITSECTORS)
+
+/* A stripe request printed. */
+struct orcase {
+    int fault;
+    enum reqnature nature;
+    unsigned offset, len; /* In sectors. */
+    enum svcmethod method;
+    unsigned read, floor, minimum;
+    int error;
+};
+
+/* What was found for one geometry. */
+struct orresult {
+    unsigned datadsks, unitsectors;
+    unsigned long sreqs[RRMETHOD + 1], above[RRMETHOD + 1];
+    double rdbytes[RRMETHOD + 1], overfloor[RRMETHOD + 1],
+      overminimum[RRMETHOD + 1];
+    unsigned long errors;
+    struct orcase *cases;
+    unsigned long casecount, casecap;
+};
+
+static struct orresult results[GEOMETRIES];
+static unsigned nextgeometry;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+
+static unsigned popcount(unsigned long set)
+{
+    unsigned n;
+
+    for (n = 0; set; set &= set - 1) ++n;
+
+    return n;
+}
+
+/* This function returns the number of rows from the first to the last in
+ * a set, that is, the length of the stretch reading them takes. */
+static unsigned span(unsigned long rows)
+{
+    unsigned first, last;
+
+    if (rows == 0) return 0;
+
+    for (first = 0; (rows >> first & 1) == 0; ++first);
+    for (last = first; rows >> last > 1; ++last);
+
+    return last - first + 1;
+}
+
+static void addcase(struct orresult *res, const struct orcase *oc)
+{
+    void *mem;
+
+    if (res->casecount == res->casecap) {
+        res->casecap = res->casecap ? 2 * res->casecap : 64;
+        if ((mem = realloc((void *) res->cases, res->casecap * sizeof
+          *res->cases)) == NULL) {
+            fprintf(stderr, "Could not get memory for the oracle's "
+              "cases.\n");
+            exit(36);
+        }
+        res->cases = (struct orcase *) mem;
+    }
+
+    res->cases[res->casecount++] = *oc;
+}
+
+/* This function plans one stripe request, offset and len sectors into
+ * stripe 0, and holds the plan up against the model. In stripe 0, unit n
+ * is on disk n, parity being unit datadsks. */
+static void checksreq(struct orresult *res, const struct dskarray *array,
+  enum reqnature nature, unsigned offset, unsigned len)
+{
+    /* Per unit, sets of rows: those requested, those read, and those
+     * needed whatever the choice, under the first choice and under the
+     * second. */
+    unsigned long req[MAXDATADSKS + 1], read[MAXDATADSKS + 1],
+      fixed[MAXDATADSKS + 1], zero[MAXDATADSKS + 1], one[MAXDATADSKS + 1];
+    struct unitscope rd[MAXDATADSKS + 1], wr[MAXDATADSKS + 1];
+    unsigned cost, n, row, start, u, units, unitsectors;
+    unsigned long choices, data, mask, need, parity, readset, sel, set0,
+      set1, written;
+    struct orcase oc;
+    struct stripeplan plan;
+
+    n = array->datadsks;
+    units = n + 1;
+    unitsectors = array->stripingunit / SECTOR;
+    data = (1UL << n) - 1;
+    parity = 1UL << n;
+
+    plan.offset = offset * SECTOR;
+    plan.len = len * SECTOR;
+    plan.rd = rd;
+    plan.wr = wr;
+
+    if (planstripereq(array, nature, &plan)) {
+        fprintf(stderr, "Could not plan a stripe request for the "
+          "oracle.\n");
+        exit(37);
+    }
+
+    memset(req, 0, sizeof req);
+    for (u = 0; u < n; ++u) {
+        start = u * unitsectors;
+        for (row = 0; row < unitsectors; ++row)
+            if (start + row >= offset && start + row < offset + len)
+                req[u] |= 1UL << row;
+    }
+
+    for (u = 0; u < units; ++u) {
+        read[u] = 0;
+        for (row = 0; row < rd[u].len / SECTOR; ++row)
+            read[u] |= 1UL << (rd[u].offset / SECTOR + row);
+    }
+
+    memset(&oc, 0, sizeof oc);
+    oc.fault = array->fltstata;
+    oc.nature = nature;
+    oc.offset = offset;
+    oc.len = len;
+    oc.method = plan.method;
+    oc.read = plan.rdbytes / SECTOR;
+
+    if (array->fltstata != FLTFREE && read[array->fltstata])
+        oc.error = 1;
+
+    memset(fixed, 0, sizeof fixed);
+    memset(zero, 0, sizeof zero);
+    memset(one, 0, sizeof one);
+    choices = 0;
+
+    for (row = 0; row < unitsectors; ++row) {
+        written = readset = 0;
+        for (u = 0; u < units; ++u) {
+            if (req[u] >> row & 1) written |= 1UL << u;
+            if (read[u] >> row & 1) readset |= 1UL << u;
+        }
+
+        need = set0 = set1 = 0;
+
+        if (nature == READREQ)
+            need = (array->fltstata != FLTFREE && written >>
+              array->fltstata & 1) ? (data | parity) & ~(1UL <<
+              array->fltstata) : written;
+        else if (written && array->fltstata != (int) n) {
+            if (array->fltstata != FLTFREE && written >> array->fltstata &
+              1)
+                need = data & ~written;
+            else {
+                set0 = written | parity;
+                set1 = (array->fltstata == FLTFREE) ? data & ~written :
+                  (data | parity) & ~(1UL << array->fltstata);
+            }
+        }
+
+        if ((need & readset) != need || set0 && (set0 & readset) != set0 &&
+          (set1 & readset) != set1)
+            oc.error = 1;
+
+        oc.minimum += popcount(need);
+        if (set0) {
+            oc.minimum += (popcount(set0) < popcount(set1)) ?
+              popcount(set0) : popcount(set1);
+            choices |= 1UL << row;
+        }
+
+        for (u = 0; u < units; ++u) {
+            if (need >> u & 1) fixed[u] |= 1UL << row;
+            if (set0 >> u & 1) zero[u] |= 1UL << row;
+            if (set1 >> u & 1) one[u] |= 1UL << row;
+        }
+    }
+
+    /* Every way of choosing, sel holding the rows taking the second
+     * choice. */
+    oc.floor = ~0U;
+    sel = 0;
+    do {
+        cost = 0;
+        for (u = 0; u < units; ++u) {
+            mask = fixed[u] | zero[u] & ~sel | one[u] & sel;
+            cost += span(mask);
+        }
+        if (cost < oc.floor) oc.floor = cost;
+        sel = (sel - choices) & choices;
+    } while (sel);
+
+    ++res->sreqs[oc.method];
+    res->rdbytes[oc.method] += plan.rdbytes;
+    if (oc.read > oc.floor) {
+        ++res->above[oc.method];
+        res->overfloor[oc.method] += (double) (oc.read - oc.floor) *
+          SECTOR;
+    }
+    if (oc.read > oc.minimum)
+        res->overminimum[oc.method] += (double) (oc.read - oc.minimum) *
+          SECTOR;
+    if (oc.error) ++res->errors;
+
+    if (oc.error || oc.read > oc.floor) addcase(res, &oc);
+}
+
+/* This function checks every stripe request of one geometry. */
+static void checkgeometry(struct orresult *res)
+{
+    unsigned len, offset, stripesectors;
+    int fault;
+    struct dskarray array;
+
+    array.lvl = RAID5;
+    array.datadsks = res->datadsks;
+    array.stripingunit = res->unitsectors * SECTOR;
+    array.sector = 0;
+
+    stripesectors = res->datadsks * res->unitsectors;
+
+    for (fault = FLTFREE; fault <= (int) res->datadsks; ++fault) {
+        array.fltstata = fault;
+        for (offset = 0; offset < stripesectors; ++offset)
+            for (len = 1; offset + len <= stripesectors; ++len) {
+                checksreq(res, &array, READREQ, offset, len);
+                checksreq(res, &array, WRITEREQ, offset, len);
+            }
+    }
+}
+
+static void *worker(void *arg)
+{
+    unsigned geometry;
+
+    for (;;) {
+        pthread_mutex_lock(&lock);
+        geometry = nextgeometry++;
+        pthread_mutex_unlock(&lock);
+
+        if (geometry >= GEOMETRIES) return NULL;
+
+        checkgeometry(&results[geometry]);
+    }
+}
+
+/* This function runs the oracle on threads threads and prints the
+ * report. */
+void runoracle(unsigned threads)
+{
+    static const char *names[RRMETHOD + 1] = {"nw", "rmw", "rw", "rw+",
+      "dr", "rr"};
+    unsigned geometry, method, i;
+    unsigned long above, errors, sreqs;
+    double overfloor, overminimum, rdbytes;
+    pthread_t *thread;
+    struct orcase *oc;
+    struct orresult *res;
+
+    if ((thread = (pthread_t *) malloc(threads * sizeof *thread)) == NULL) {
+        fprintf(stderr, "Could not get memory for the oracle's "
+          "threads.\n");
+        exit(38);
+    }
+
+    memset(results, 0, sizeof results);
+    for (geometry = 0; geometry < GEOMETRIES; ++geometry) {
+        results[geometry].datadsks = 2 + geometry / MAXUNITSECTORS;
+        results[geometry].unitsectors = 1 + geometry % MAXUNITSECTORS;
+    }
+    nextgeometry = 0;
+
+    for (i = 0; i < threads; ++i)
+        if (pthread_create(&thread[i], NULL, worker, NULL)) {
+            fprintf(stderr, "Could not start an oracle thread.\n");
+            exit(39);
+        }
+
+    for (i = 0; i < threads; ++i) pthread_join(thread[i], NULL);
+
+    free((void *) thread);
+
+    printf("# datadsks unit fault nature offset len method read floor "
+      "minimum\n");
+
+    for (res = results; res < results + GEOMETRIES; ++res)
+        for (oc = res->cases; oc < res->cases + res->casecount; ++oc)
+            printf("%s%u %u %d %c %u %u %s %u %u %u\n", oc->error ?
+              "ERROR " : "", res->datadsks, res->unitsectors, oc->fault,
+              (oc->nature == WRITEREQ) ? 'w' : 'r', oc->offset, oc->len,
+              names[oc->method], oc->read, oc->floor, oc->minimum);
+
+    printf("\n%-6s %10s %10s %14s %14s %14s\n", "method", "stripereqs",
+      "above", "bytes read", "over floor", "over minimum");
+
+    errors = 0;
+    for (method = 0; method <= RRMETHOD; ++method) {
+        sreqs = above = 0;
+        rdbytes = overfloor = overminimum = 0;
+
+        for (res = results; res < results + GEOMETRIES; ++res) {
+            sreqs += res->sreqs[method];
+            above += res->above[method];
+            rdbytes += res->rdbytes[method];
+            overfloor += res->overfloor[method];
+            overminimum += res->overminimum[method];
+        }
+
+        printf("%-6s %10lu %10lu %14.0f %14.0f %14.0f\n", names[method],
+          sreqs, above, rdbytes, overfloor, overminimum);
+    }
+
+    for (res = results; res < results + GEOMETRIES; ++res) {
+        errors += res->errors;
+        free((void *) res->cases);
+    }
+
+    printf("%lu plans read the faulty disk or too little.\n", errors);
+}
+
+/* vim: set cindent shiftwidth=4 expandtab: */
@@ -0,0 +1,302 @@
+/* Threads and clocks are POSIX matters. */
+#define _POSIX_C_SOURCE 200112L
+
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+
+#include "simint.h"
+
+/* This file runs the simulation as a pipeline of four stages, each on a
+ * thread of its own: job decoding, expansion of the RAID request into
+ * stripe requests, planning of the stripe requests, and rendering. Jobs
+ * travel between the stages in work items, which are handed along bounded
+ * single-producer single-consumer queues and, once rendered, returned to
+ * the decoding stage for reuse. As there is one queue between any two
+ * stages, jobs are rendered in the order they were decoded, and the output
+ * is the same as that of the serial simulator.
+ *
+ * The queues are lock-free. They rely on the __atomic built-ins of GCC
+ * and Clang, which are not part of C89. */
+
+/* Rendering is done by the usual code in reqsim.c, as are readying the
+ * plans and the reports on what they add up to. */
+extern void renderjob(struct job *jb, struct ioplan *plan);
+extern void attachplan(struct ioplan *plan);
+extern void detachplan(struct ioplan *plan);
+extern void addtotals(const struct job *jb, const struct ioplan *plan);
+extern void reporttotals();
+
+/* Slots in a queue. Must be a power of two. Also the number of work items
+ * in circulation, which means a push never has to wait for long. */
+#define QUEUELEN 64
+
+/* A single-producer single-consumer queue. The producer owns tail, the
+ * consumer owns head, and each reads the other's index only. The padding
+ * keeps the two indices on separate cache lines. */
+struct spscq {
+    void *slot[QUEUELEN];
+    unsigned long head;
+    char pad[64];
+    unsigned long tail;
+};
+
+/* A work item: a job and the plan made for it. */
+struct work {
+    struct job jb;
+    struct ioplan plan;
+    int ok; /* Whether the job could be expanded. */
+};
+
+/* Accounting for one stage. Busy time is the time spent neither waiting
+ * for input nor for room to put the output. */
+struct stage {
+    const char *name;
+    pthread_t thread;
+    struct spscq *in, *out;
+    unsigned long jobs, sreqs;
+    double wait, total;
+};
+
+static struct jobsrc *jobsrc; /* Where the decoding stage gets jobs. */
+
+static double now()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* This function puts an item at the tail of a queue, waiting for room if
+ * needed. The time spent waiting is charged to the stage. */
+static void push(struct stage *st, void *item)
+{
+    struct spscq *q = st->out;
+    unsigned long tail;
+    double start;
+
+    tail = q->tail;
+
+    if (tail - __atomic_load_n(&q->head, __ATOMIC_ACQUIRE) == QUEUELEN) {
+        start = now();
+        while (tail - __atomic_load_n(&q->head, __ATOMIC_ACQUIRE) ==
+          QUEUELEN)
+            sched_yield();
+        st->wait += now() - start;
+    }
+
+    q->slot[tail & (QUEUELEN - 1)] = item;
+    __atomic_store_n(&q->tail, tail + 1, __ATOMIC_RELEASE);
+}
+
+/* This function takes the item at the head of a queue, waiting for one if
+ * needed. */
+static void *pop(struct stage *st)
+{
+    struct spscq *q = st->in;
+    unsigned long head;
+    double start;
+    void *item;
+
+    head = q->head;
+
+    if (__atomic_load_n(&q->tail, __ATOMIC_ACQUIRE) == head) {
+        start = now();
+        while (__atomic_load_n(&q->tail, __ATOMIC_ACQUIRE) == head)
+            sched_yield();
+        st->wait += now() - start;
+    }
+
+    item = q->slot[head & (QUEUELEN - 1)];
+    __atomic_store_n(&q->head, head + 1, __ATOMIC_RELEASE);
+
+    return item;
+}
+
+/* The stages follow. Each passes NULL along once it has seen the last
+ * job. */
+
+static void *decode(void *arg)
+{
+    struct stage *st = (struct stage *) arg;
+    struct work *w;
+    double start;
+
+    start = now();
+
+    for (;;) {
+        w = (struct work *) pop(st);
+
+        if (jobsrc->next(jobsrc, &w->jb)) break;
+
+        ++st->jobs;
+        push(st, w);
+    }
+
+    push(st, NULL);
+
+    st->total = now() - start;
+
+    return NULL;
+}
+
+static void *expand(void *arg)
+{
+    struct stage *st = (struct stage *) arg;
+    struct work *w;
+    double start;
+
+    start = now();
+
+    while ((w = (struct work *) pop(st)) != NULL) {
+        w->ok = expandioplan(&w->jb.array, &w->jb.req, &w->plan) == 0;
+
+        ++st->jobs;
+        if (w->ok) st->sreqs += w->plan.sreqcount;
+        push(st, w);
+    }
+
+    push(st, NULL);
+
+    st->total = now() - start;
+
+    return NULL;
+}
+
+static void *plan(void *arg)
+{
+    struct stage *st = (struct stage *) arg;
+    struct work *w;
+    double start;
+
+    start = now();
+
+    while ((w = (struct work *) pop(st)) != NULL) {
+        if (w->ok) {
+            planioplan(&w->jb.array, w->jb.req.nature, &w->plan);
+            st->sreqs += w->plan.sreqcount;
+        }
+
+        ++st->jobs;
+        push(st, w);
+    }
+
+    push(st, NULL);
+
+    st->total = now() - start;
+
+    return NULL;
+}
+
+static void *render(void *arg)
+{
+    struct stage *st = (struct stage *) arg;
+    struct work *w;
+    double start;
+
+    start = now();
+
+    while ((w = (struct work *) pop(st)) != NULL) {
+        if (w->ok) {
+            renderjob(&w->jb, &w->plan);
+            addtotals(&w->jb, &w->plan);
+            st->sreqs += w->plan.sreqcount;
+        }
+        else
+            fprintf(stderr, "Could not plan the RAID request; "
+              "skipped.\n");
+
+        ++st->jobs;
+        push(st, w); /* Back to the decoding stage. */
+    }
+
+    fflush(stdout);
+
+    st->total = now() - start;
+
+    return NULL;
+}
+
+/* This function prints the accounting of every stage to stderr. The stage
+ * with the most busy time limits the pipeline and is marked with '*'. */
+static void report(struct stage *stages, unsigned count)
+{
+    unsigned i, slowest;
+    double busy;
+
+    slowest = 0;
+    for (i = 1; i < count; ++i)
+        if (stages[i].total - stages[i].wait > stages[slowest].total -
+          stages[slowest].wait)
+            slowest = i;
+
+    fprintf(stderr, "%-8s %10s %12s %10s %10s %12s %12s\n", "stage",
+      "jobs", "stripereqs", "busy s", "wait s", "jobs/s", "stripereqs/s");
+
+    for (i = 0; i < count; ++i) {
+        busy = stages[i].total - stages[i].wait;
+        if (busy <= 0) busy = 1e-9;
+
+        fprintf(stderr, "%-7s%c %10lu %12lu %10.6f %10.6f %12.0f %12.0f\n",
+          stages[i].name, (i == slowest) ? '*' : ' ', stages[i].jobs,
+          stages[i].sreqs, busy, stages[i].wait, stages[i].jobs / busy,
+          stages[i].sreqs / busy);
+    }
+}
+
+/* This function runs every job from the source through the pipeline and
+ * reports on the stages when done. */
+void runpipeline(struct jobsrc *src)
+{
+    static struct spscq queues[4];
+    static struct work works[QUEUELEN];
+    static void *(*run[4])(void *) = {decode, expand, plan, render};
+    static const char *names[4] = {"decode", "expand", "plan", "render"};
+    struct stage stages[4];
+    unsigned i;
+
+    jobsrc = src;
+
+    /* queues[i] feeds stage i. The work items start out in the queue
+     * feeding the decoding stage. Only the planning stage uses the cache
+     * and the known-zero map, one plan after another, so every plan
+     * shares those of the first. */
+    memset(queues, 0, sizeof queues);
+    for (i = 0; i < QUEUELEN; ++i) {
+        initioplan(&works[i].plan);
+        if (i == 0)
+            attachplan(&works[i].plan);
+        else {
+            works[i].plan.model = works[0].plan.model;
+            works[i].plan.cache = works[0].plan.cache;
+            works[i].plan.zeros = works[0].plan.zeros;
+        }
+        queues[0].slot[i] = &works[i];
+    }
+    queues[0].tail = QUEUELEN;
+
+    memset(stages, 0, sizeof stages);
+
+    for (i = 0; i < 4; ++i) {
+        stages[i].name = names[i];
+        stages[i].in = &queues[i];
+        stages[i].out = &queues[(i + 1) % 4];
+
+        if (pthread_create(&stages[i].thread, NULL, run[i], &stages[i])) {
+            fprintf(stderr, "Could not start the %s stage.\n", names[i]);
+            exit(14);
+        }
+    }
+
+    for (i = 0; i < 4; ++i) pthread_join(stages[i].thread, NULL);
+
+    report(stages, 4);
+    reporttotals();
+
+    detachplan(&works[0].plan);
+    for (i = 0; i < QUEUELEN; ++i) freeioplan(&works[i].plan);
+}
+
+/* vim: set cindent shiftwidth=4 expandtab: */
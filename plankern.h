@@ -0,0 +1,485 @@
+/* The stripe request planner, as a template. libreqsim.c includes this
+ * file once for the generic kernel, and once more for every geometry
+ * planned with a kernel of its own (see GEOMETRIES in the Makefile), each
+ * time defining
+ *
+ *     K(name)    the name of a function in this kernel
+ *     LEVEL      the RAID level of the array
+ *     DATADSKS   its number of data disks
+ *     UNITLEN    its striping unit, in bytes
+ *     SECTORLEN  its sector size, in bytes
+ *
+ * For the generic kernel, the geometry is read from c->array. For the
+ * others, it is made of constants, so that the compiler can fold the
+ * divisions, modulos and loops over the disks which depend on it. The
+ * macros are undefined at the end. */
+
+/* This function maps disks to stripe units. For RAID4 arrays, it is an
+ * identity function. For RAID5, left-symmetric placement is assumed. */
+static unsigned K(disktounit)(struct sreqctx *c, unsigned disk)
+{
+    return (LEVEL == RAID4) ? disk : (disk + c->stripe) %
+      (DATADSKS + 1);
+}
+
+/* This function spreads a scope table over the disks of the array,
+ * storing one scope per disk in disk order. The number of bytes recorded
+ * is returned. */
+static unsigned K(scopestodisks)(struct sreqctx *c, struct scopetab *scopes,
+  struct unitscope *dskscopes)
+{
+    static const struct unitscope none = {0, 0};
+    unsigned bytes, disk, unit;
+
+    bytes = 0;
+
+    for (disk = 0; disk <= DATADSKS; ++disk) {
+        unit = K(disktounit)(c, disk);
+
+        if (unit == DATADSKS)
+            dskscopes[disk] = scopes->parity;
+        else if (unit < c->firstunit || unit > c->finalunit)
+            dskscopes[disk] = scopes->offreq;
+        else if (unit == c->firstunit)
+            dskscopes[disk] = scopes->req1;
+        else if (unit == c->finalunit)
+            dskscopes[disk] = scopes->req2;
+        /* Reconstruct-read is the only request service method which may
+         * give a group scope (req3) even as one of the member units is
+         * faulty. */
+        else if (unit == c->fltstats)
+            dskscopes[disk] = none;
+        else
+            dskscopes[disk] = scopes->req3;
+
+        bytes += dskscopes[disk].len;
+    }
+
+    return bytes;
+}
+
+/* This function returns the number of bytes a scope table amounts to. */
+static unsigned K(scopebytes)(struct sreqctx *c, struct scopetab *scopes)
+{
+    unsigned groupunits; /* Units covered by the group scope (req3). */
+
+    groupunits = (c->requnits > 2) ? c->requnits - 2 : 0;
+    if (groupunits && c->fltstats > (int) c->firstunit && c->fltstats <
+      (int) c->finalunit)
+        --groupunits;
+
+    return scopes->req1.len +
+      scopes->req2.len +
+      scopes->req3.len * groupunits +
+      scopes->offreq.len * (DATADSKS - c->requnits) +
+      scopes->parity.len;
+}
+
+/* This function counts the disks a list of per-disk scopes touches. */
+static unsigned K(countops)(struct sreqctx *c, struct unitscope *dskscopes)
+{
+    unsigned disk, ops;
+
+    ops = 0;
+
+    for (disk = 0; disk <= DATADSKS; ++disk)
+        if (dskscopes[disk].len) ++ops;
+
+    return ops;
+}
+
+/* Nonredundant-write stripe request service method. */
+static unsigned K(nwmethod)(struct sreqctx *c, struct scopetab *inscopes,
+  struct scopetab *outscopes)
+{
+    struct scopetab none = {{0, 0}};
+
+    *outscopes = none;
+
+    return 0;
+}
+
+/* Read-modify-write stripe request service method. The methods fill in
+ * the scopes to be read and return the number of bytes this amounts to.
+ * The return value alone is of interest when verifying read-modify-write
+ * is indeed more efficient than reconstruct-write in cases where the
+ * former is considered the primary choice. This is needed in order to
+ * develop trust in the rmw-rw cut-off confition. See processwrite. */
+static unsigned K(rmwmethod)(struct sreqctx *c, struct scopetab *inscopes,
+  struct scopetab *outscopes)
+{
+    *outscopes = *inscopes;
+
+    if (c->requnits == 1)
+        outscopes->parity = outscopes->req1;
+    else {
+        outscopes->parity.offset = 0;
+        outscopes->parity.len = UNITLEN;
+    }
+
+    return K(scopebytes)(c, outscopes);
+}
+
+/* Reconstruct-write stripe request service method. See the comment in
+ * front of rmwmethod. */
+static unsigned K(rwmethod)(struct sreqctx *c, struct scopetab *inscopes,
+  struct scopetab *outscopes)
+{
+    struct scopetab none = {{0, 0}};
+
+    *outscopes = none;
+
+    if (c->requnits == 1)
+        /* For XOR to work, there need to be at least two data disks. With
+         * one request unit, we can be sure there is at least one unit
+         * left off request. */
+        outscopes->offreq = inscopes->req1;
+    else {
+        if (inscopes->req1.len < UNITLEN)
+            /* Read the first unit's scope complement. */
+            /* The default offset (0) is adequate. */
+            outscopes->req1.len = inscopes->req1.offset;
+        if (inscopes->req2.len < UNITLEN) {
+            /* Read the final unit's scope complement. */
+            outscopes->req2.offset = inscopes->req2.len;
+            outscopes->req2.len = UNITLEN - inscopes->req2.len;
+        }
+        /* With more than one request unit, we cannot be sure there are
+         * any units left off request. */
+        if (c->requnits < DATADSKS)
+            /* The default offset (0) is adequate. */
+            outscopes->offreq.len = UNITLEN;
+    }
+
+    return K(scopebytes)(c, outscopes);
+}
+
+/* Reconstruct-write-plus stripe request service method. Unlike the other
+ * methods, this one is original. It is based on a mathematically-derived
+ * parity function. Optimal over read-modify-write and reconstruct-write
+ * in certain cases (see the condition for the rw+ branch in
+ * processwrite). */
+static unsigned K(rwplusmethod)(struct sreqctx *c, struct scopetab *inscopes,
+  struct scopetab *outscopes)
+{
+    struct scopetab none = {{0, 0}};
+    struct unitscope complement; /* Faulty unit scope complement. */
+
+    *outscopes = none;
+
+    if (c->fltstats == c->firstunit) {
+        complement.offset = 0;
+        complement.len = inscopes->req1.offset;
+        if (inscopes->req2.len == UNITLEN)
+            outscopes->req2 = complement;
+        else
+            /* The default offset (0) is adequate. */
+            outscopes->req2.len = UNITLEN;
+        if (c->requnits < DATADSKS)
+            outscopes->offreq = inscopes->req1;
+    }
+    else
+    {
+        complement.offset = inscopes->req2.len;
+        complement.len = UNITLEN - complement.offset;
+        if (inscopes->req1.len == UNITLEN)
+            outscopes->req1 = complement;
+        else
+            /* The default offset (0) is adequate. */
+            outscopes->req1.len = UNITLEN;
+        if (c->requnits < DATADSKS)
+            outscopes->offreq = inscopes->req2;
+    }
+    if (c->requnits > 2)
+        outscopes->req3 = complement;
+    outscopes->parity = complement;
+
+    return K(scopebytes)(c, outscopes);
+}
+
+/* This function chooses the appropriate stripe request service method for
+ * writes. */
+static enum svcmethod K(processwrite)(struct sreqctx *c, struct scopetab
+  *inscopes, struct scopetab *outscopes)
+{
+    unsigned primary, secondary;
+    struct scopetab scratch;
+
+    if (c->fltstats == FLTFREE) {
+        /* The rmw-rw cut-off condition referred to in various places. It
+         * is a request lengh mark where read-modify-write becomes more
+         * efficient than reconstruct-write or vice versa. requnits != 1
+         * does not represent any extra knowledge. It is added only so we
+         * can have two branches instead of four. */
+        if (c->requnits == 1 && DATADSKS > 3 || c->requnits != 1 &&
+          UNITLEN * (DATADSKS - 1) > 2 * c->plan->len) {
+            primary = K(rmwmethod)(c, inscopes, outscopes);
+            secondary = K(rwmethod)(c, inscopes, &scratch);
+            assert(primary <= secondary);
+            return RMWMETHOD;
+        }
+        else {
+            secondary = K(rmwmethod)(c, inscopes, &scratch);
+            primary = K(rwmethod)(c, inscopes, outscopes);
+            assert(primary <= secondary);
+            return RWMETHOD;
+        }
+    }
+    else if (c->fltstats == PARITY_UNIT) {
+        K(nwmethod)(c, inscopes, outscopes);
+        return NWMETHOD;
+    }
+    /* If an off-request unit is faulty. */
+    else if (c->fltstats < c->firstunit || c->fltstats > c->finalunit) {
+        K(rmwmethod)(c, inscopes, outscopes);
+        return RMWMETHOD;
+    }
+    /* If there is one request unit, or the faulty unit changes
+     * completely. */
+    else if (c->requnits == 1 || c->fltstats > c->firstunit && c->fltstats
+      < c->finalunit || c->fltstats == c->firstunit && inscopes->req1.len
+      == UNITLEN || c->fltstats == c->finalunit &&
+      inscopes->req2.len == UNITLEN) {
+        K(rwmethod)(c, inscopes, outscopes);
+        return RWMETHOD;
+    }
+    else {
+        /* There are two or more request units, and the faulty unit
+         * changes partially. */
+        K(rwplusmethod)(c, inscopes, outscopes);
+        return RWPLUSMETHOD;
+    }
+}
+
+/* Direct-read stripe request service method. Old method, new name. */
+static unsigned K(drmethod)(struct sreqctx *c, struct scopetab *inscopes,
+  struct scopetab *outscopes)
+{
+    *outscopes = *inscopes;
+
+    return K(scopebytes)(c, outscopes);
+}
+
+/* This function returns the scope of the faulty unit, which must be a
+ * request unit. */
+static struct unitscope K(faultyscope)(struct sreqctx *c, struct scopetab
+  *inscopes)
+{
+    if (c->fltstats == c->firstunit)
+        return inscopes->req1;
+    else if (c->fltstats < c->finalunit)
+        return inscopes->req3;
+    else
+        return inscopes->req2;
+}
+
+/* Reconstruct-read stripe request service method. */
+static unsigned K(rrmethod)(struct sreqctx *c, struct scopetab *inscopes,
+  struct scopetab *outscopes)
+{
+    struct scopetab none = {{0, 0}};
+    struct unitscope fltscope; /* Faulty unit scope. */
+
+    *outscopes = none;
+
+    if (c->requnits > 1) {
+        if (c->fltstats != c->firstunit) {
+            outscopes->req1.offset = 0;
+            outscopes->req1.len = UNITLEN;
+        }
+        if (c->requnits > 2 && (c->fltstats == c->firstunit || c->fltstats
+          == c->finalunit) || c->requnits > 3) {
+            outscopes->req3.offset = 0;
+            outscopes->req3.len = UNITLEN;
+        }
+        if (c->fltstats != c->finalunit) {
+            outscopes->req2.offset = 0;
+            outscopes->req2.len = UNITLEN;
+        }
+    }
+
+    fltscope = K(faultyscope)(c, inscopes);
+
+    if (c->requnits < DATADSKS)
+        outscopes->offreq = fltscope;
+
+    outscopes->parity = fltscope;
+
+    return K(scopebytes)(c, outscopes);
+}
+
+/* This function chooses the appropriate stripe request service method for
+ * reads. */
+static enum svcmethod K(processread)(struct sreqctx *c, struct scopetab
+  *inscopes, struct scopetab *outscopes)
+{
+    if (c->fltstats >= (int) c->firstunit && c->fltstats <= (int)
+      c->finalunit) {
+        /* A request unit is faulty. */
+        if (c->cache && rrfromcache(c, inscopes, outscopes))
+            return DRMETHOD;
+        K(rrmethod)(c, inscopes, outscopes);
+        if (c->cache) rrkeep(c, inscopes);
+        return RRMETHOD;
+    }
+    else {
+        /* The stripe is fault-free, or either the parity unit or an
+         * off-request unit is faulty. */
+        K(drmethod)(c, inscopes, outscopes);
+        return DRMETHOD;
+    }
+}
+
+/* This function records what a write stripe request puts on each disk:
+ * the new data for every request unit except a faulty one, and the new
+ * parity unless the parity unit is faulty. Parity covers the request unit
+ * scope when there is a single request unit, and the whole unit
+ * otherwise, just as it is read under read-modify-write. */
+static unsigned K(planwrites)(struct sreqctx *c, struct scopetab *inscopes)
+{
+    struct scopetab outscopes = *inscopes;
+
+    if (c->fltstats != PARITY_UNIT)
+        K(rmwmethod)(c, inscopes, &outscopes);
+
+    if (c->fltstats == (int) c->firstunit)
+        outscopes.req1.len = 0;
+    else if (c->fltstats == (int) c->finalunit)
+        outscopes.req2.len = 0;
+
+    return K(scopestodisks)(c, &outscopes, c->plan->wr);
+}
+
+/* This function adds the reads needed to read-modify-write the partial
+ * sectors of a write stripe request (see struct stripeplan) to the reads
+ * of the service method. The old contents of such a sector are read
+ * where they lie or, if that unit is faulty, rebuilt from the same
+ * sector of every other unit. Nothing is added when the method reads the
+ * sector anyway, as read-modify-write does. The new number of bytes read
+ * is returned. */
+static unsigned K(readpartials)(struct sreqctx *c)
+{
+    unsigned bit, bytes, disk, sector, sreloffset, stripelen, unit,
+      ureloffset;
+    struct stripeplan *plan = c->plan;
+
+    sector = SECTORLEN;
+    stripelen = DATADSKS * UNITLEN;
+
+    for (bit = 0; bit < 2; ++bit) {
+        if ((plan->partial & 1 << bit) == 0) continue;
+
+        sreloffset = plan->offset % stripelen + (bit ? plan->len - sector :
+          0);
+        unit = sreloffset / UNITLEN;
+        ureloffset = sreloffset % UNITLEN;
+
+        for (disk = 0; disk <= DATADSKS; ++disk)
+            if ((int) unit == c->fltstats ? K(disktounit)(c, disk) != unit :
+              K(disktounit)(c, disk) == unit)
+                widenscope(&plan->rd[disk], ureloffset, sector);
+    }
+
+    bytes = 0;
+    for (disk = 0; disk <= DATADSKS; ++disk)
+        bytes += plan->rd[disk].len;
+
+    return bytes;
+}
+
+/* This function does preliminary processing of the current stripe
+ * request, then calls one of two request nature-specific functions to
+ * continue the work. In particular, processreq figures out the number of
+ * request units as well as the first and final request units, translates
+ * a single offset-length pair into a bunch of scopes, and finally sets up
+ * the stripe fault status. */
+static void K(processreq)(struct sreqctx *c)
+{
+    /* Extended length concept as in expandraidreq only here for a stripe
+     * request rather than a RAID one. */
+    unsigned extlen;
+    /* Request offset relative to the stripe (s) and the first request
+     * unit (u), respectively. */
+    unsigned sreloffset;
+    unsigned ureloffset;
+    struct scopetab inscopes = {{0, 0}}, outscopes;
+    struct stripeplan *plan = c->plan;
+
+    c->stripe = plan->offset / (DATADSKS * UNITLEN);
+
+    sreloffset = plan->offset - c->stripe * (DATADSKS * UNITLEN);
+    c->firstunit = sreloffset / UNITLEN;
+    ureloffset = sreloffset - c->firstunit * UNITLEN;
+
+    extlen = plan->len + ureloffset;
+    c->requnits = extlen / UNITLEN;
+    if (extlen - c->requnits * UNITLEN) ++c->requnits;
+
+    c->finalunit = c->firstunit + c->requnits - 1;
+
+    inscopes.req1.offset = ureloffset;
+    inscopes.req1.len = (c->requnits == 1) ? plan->len : UNITLEN -
+      inscopes.req1.offset;
+
+    if (c->requnits > 1) {
+        /* The default offset (0) is adequate. */
+        inscopes.req2.len = plan->len - inscopes.req1.len - (c->requnits -
+          2) * UNITLEN;
+
+        if (c->requnits > 2)
+            /* The default offset (0) is adequate. */
+            inscopes.req3.len = UNITLEN;
+    }
+
+    if (c->array->fltstata == FLTFREE)
+        c->fltstats = FLTFREE;
+    else {
+        c->fltstats = K(disktounit)(c, c->array->fltstata);
+        if (c->fltstats == DATADSKS) c->fltstats = PARITY_UNIT;
+    }
+
+    plan->stripe = c->stripe;
+
+    if (c->nature == WRITEREQ) {
+        plan->wrbytes = K(planwrites)(c, &inscopes);
+        plan->method = K(processwrite)(c, &inscopes, &outscopes);
+        if (c->model)
+            plan->method = costwrite(c, &inscopes, &outscopes,
+              plan->method);
+        if (c->cache) rrforget(c, &inscopes);
+    }
+    else if (c->nature == DISCARDREQ) {
+        /* See enum reqnature. */
+        plan->method = NWMETHOD;
+        plan->rdbytes = plan->wrbytes = plan->rdops = plan->wrops = 0;
+        memset(plan->rd, 0, (DATADSKS + 1) * sizeof *plan->rd);
+        memset(plan->wr, 0, (DATADSKS + 1) * sizeof *plan->wr);
+        if (plan->len == DATADSKS * UNITLEN) {
+            if (c->cache) rrforget(c, &inscopes);
+            if (c->zeros) zerodiscarded(c);
+        }
+        return;
+    }
+    else {
+        plan->method = K(processread)(c, &inscopes, &outscopes);
+        plan->wrbytes = 0;
+        memset(plan->wr, 0, (DATADSKS + 1) * sizeof *plan->wr);
+    }
+
+    plan->rdbytes = K(scopestodisks)(c, &outscopes, plan->rd);
+    if (plan->partial) plan->rdbytes = K(readpartials)(c);
+    if (c->zeros) {
+        plan->rdbytes = zeroreads(c);
+        if (c->nature == WRITEREQ) zerowritten(c);
+    }
+    plan->rdops = K(countops)(c, plan->rd);
+    plan->wrops = K(countops)(c, plan->wr);
+}
+
+#undef K
+#undef LEVEL
+#undef DATADSKS
+#undef UNITLEN
+#undef SECTORLEN
+
+/* vim: set cindent shiftwidth=4 expandtab: */
@@ -0,0 +1,343 @@
+#include <limits.h>
+
+#include "simint.h"
+
+/* This file models read-ahead in front of the array. Jobs are planned one
+ * at a time as usual, which is what the array does without read-ahead.
+ * With it, sequential streams of reads are detected across jobs: a read
+ * beginning where one of the last STREAMS streams left off extends it,
+ * and once a stream is TRIGGER reads long, the stripes ahead of it are
+ * prefetched into a buffer, depth stripes deep. The buffer is topped up
+ * whenever fewer than half of those stripes are in it, with a single
+ * multi-stripe read, which takes one operation per disk, the stripe units
+ * of consecutive stripes lying next to one another on every disk. A read
+ * stripe request whose stripe is in the buffer is served from it and
+ * reads nothing; writes update the buffer along with the disks. The
+ * buffer holds STREAMS times twice depth stripes, the oldest making way
+ * for the newest.
+ *
+ * The report compares the operations and bytes every disk carries with
+ * and without read-ahead, and tells how much of what was prefetched was
+ * never read, counting by sector, by the time it left the buffer or the
+ * jobs ran out. The buffer starts out empty for every new array. */
+
+#define STREAMS 8
+#define TRIGGER 2
+
+struct stream {
+    unsigned long next;  /* Where the next read is expected. */
+    unsigned long reads; /* Reads so far. */
+    unsigned long used;  /* When last extended, in jobs. */
+};
+
+/* A stripe in the buffer, and the sectors of it read. */
+struct entry {
+    unsigned long stripe;
+    int valid;
+    unsigned long *used;
+};
+
+struct disk {
+    unsigned long ops, raops;
+    double bytes, rabytes;
+};
+
+static struct stream streams[STREAMS];
+static struct entry *buffer;
+static unsigned long *maps;   /* Storage behind the used maps. */
+static unsigned capacity;     /* Stripes the buffer holds. */
+static unsigned oldest;       /* The entry to make way next. */
+static unsigned stripesectors, words;
+static struct disk disks[MAXDISKS];
+static unsigned dsks;         /* Disks seen, the most in any array. */
+/* Streams detected, read stripe requests in all and served from the
+ * buffer, and sectors prefetched and never read. */
+static unsigned long detected, reads, hits;
+static double prefetched, wasted;
+
+/* This function takes a stripe out of the buffer, counting what of it was
+ * never read. */
+static void evict(struct entry *e)
+{
+    if (!e->valid) return;
+
+    wasted += stripesectors - secmapcount(e->used, words);
+    e->valid = 0;
+}
+
+/* This function empties the buffer and sizes it for the array. */
+static void resetbuffer(const struct dskarray *array, unsigned depth)
+{
+    unsigned i;
+    void *mem;
+
+    for (i = 0; i < capacity; ++i) evict(&buffer[i]);
+
+    stripesectors = array->datadsks * (array->stripingunit /
+      ARRAYSECTOR(array));
+    words = SECMAPWORDS(stripesectors);
+    capacity = STREAMS * 2 * depth;
+
+    if ((mem = realloc((void *) maps, capacity * words * sizeof *maps)) ==
+      NULL) {
+        fprintf(stderr, "Could not get memory for the read-ahead "
+          "buffer.\n");
+        exit(45);
+    }
+    maps = (unsigned long *) mem;
+
+    for (i = 0; i < capacity; ++i) {
+        buffer[i].valid = 0;
+        buffer[i].used = maps + i * words;
+    }
+
+    oldest = 0;
+    memset(streams, 0, sizeof streams);
+}
+
+static struct entry *lookup(unsigned long stripe)
+{
+    unsigned i;
+
+    for (i = 0; i < capacity; ++i)
+        if (buffer[i].valid && buffer[i].stripe == stripe)
+            return &buffer[i];
+
+    return NULL;
+}
+
+/* This function reads stripes first to last into the buffer, as a single
+ * read on every disk, or as several if the stripes are more than a RAID
+ * request can span. */
+static void prefetch(const struct dskarray *array, unsigned long first,
+  unsigned long last, struct ioplan *plan)
+{
+    unsigned disk;
+    unsigned long end, perread, stripe, stripelen;
+    double bytes[MAXDISKS];
+    struct raidreq req;
+    struct stripeplan *sp;
+    struct entry *e;
+
+    stripelen = array->datadsks * array->stripingunit;
+    perread = UINT_MAX / stripelen;
+
+    for (; first <= last; first = end + 1) {
+        end = (last - first < perread) ? last : first + perread - 1;
+
+        req.nature = READREQ;
+        req.offset = first * stripelen;
+        req.len = (end - first + 1) * stripelen;
+        req.time = 0;
+
+        if (planraidreq(array, &req, plan)) {
+            fprintf(stderr, "Could not plan the read-ahead of stripes %lu "
+              "to %lu; skipped.\n", first, end);
+            continue;
+        }
+
+        memset(bytes, 0, sizeof bytes);
+        for (sp = plan->sreqs; sp < plan->sreqs + plan->sreqcount; ++sp)
+            for (disk = 0; disk <= array->datadsks; ++disk)
+                bytes[disk] += sp->rd[disk].len;
+
+        for (disk = 0; disk <= array->datadsks; ++disk)
+            if (bytes[disk]) {
+                ++disks[disk].raops;
+                disks[disk].rabytes += bytes[disk];
+            }
+
+        for (stripe = first; stripe <= end; ++stripe) {
+            e = &buffer[oldest];
+            oldest = (oldest + 1) % capacity;
+            evict(e);
+            e->stripe = stripe;
+            e->valid = 1;
+            secmapclear(e->used, words * SECMAPBITS);
+            prefetched += stripesectors;
+        }
+    }
+}
+
+/* This function follows the streams with a read of len bytes at offset,
+ * and returns the stream if it is long enough to read ahead of, or NULL
+ * otherwise. */
+static struct stream *follow(unsigned long offset, unsigned long len,
+  unsigned long job)
+{
+    struct stream *s, *lru;
+
+    lru = streams;
+    for (s = streams; s < streams + STREAMS; ++s) {
+        if (s->reads && s->next == offset) break;
+        if (s->used < lru->used) lru = s;
+    }
+
+    if (s == streams + STREAMS) {
+        s = lru;
+        s->reads = 0;
+    }
+
+    s->next = offset + len;
+    s->used = job;
+    if (++s->reads == TRIGGER) ++detected;
+
+    return (s->reads >= TRIGGER) ? s : NULL;
+}
+
+/* This function tops up the buffer ahead of a stream. */
+static void readahead(const struct dskarray *array, const struct stream
+  *s, unsigned depth, struct ioplan *plan)
+{
+    unsigned long first, last, stripe, stripelen;
+
+    stripelen = array->datadsks * array->stripingunit;
+    first = s->next / stripelen;
+    last = first + depth - 1;
+
+    /* Offsets are 32 bits wide; no stripe past them is read. */
+    if (last >= UINT_MAX / ARRAYSECTOR(array) * ARRAYSECTOR(array) /
+      stripelen)
+        last = UINT_MAX / ARRAYSECTOR(array) * ARRAYSECTOR(array) /
+          stripelen - 1;
+    if (first > last) return;
+
+    for (stripe = first; stripe <= last && lookup(stripe); ++stripe);
+
+    if (stripe - first >= (depth + 1) / 2) return;
+
+    /* From the first stripe missing on, so that the read is one. */
+    prefetch(array, stripe, last, plan);
+}
+
+/* This function prints the report. */
+static void report(unsigned depth, unsigned sector)
+{
+    unsigned disk;
+    unsigned long ops, raops;
+    double bytes, rabytes;
+
+    printf("%-5s %12s %12s %8s %12s %12s\n", "disk", "ops", "ops ra",
+      "saved %", "MB", "MB ra");
+
+    ops = raops = 0;
+    bytes = rabytes = 0;
+
+    for (disk = 0; disk < dsks; ++disk) {
+        printf("%-5u %12lu %12lu %8.1f %12.3f %12.3f\n", disk,
+          disks[disk].ops, disks[disk].raops, disks[disk].ops ? 100.0 *
+          ((double) disks[disk].ops - disks[disk].raops) / disks[disk].ops
+          : 0, disks[disk].bytes / 1e6, disks[disk].rabytes / 1e6);
+        ops += disks[disk].ops;
+        raops += disks[disk].raops;
+        bytes += disks[disk].bytes;
+        rabytes += disks[disk].rabytes;
+    }
+
+    printf("%-5s %12lu %12lu %8.1f %12.3f %12.3f\n", "all", ops, raops, ops
+      ? 100.0 * ((double) ops - raops) / ops : 0, bytes / 1e6, rabytes /
+      1e6);
+
+    printf("\nRead-ahead %u stripes deep: %lu streams detected, %lu of %lu "
+      "read stripe requests served from the buffer, %.3f MB prefetched, "
+      "%.3f MB (%.1f%%) of it never read.\n", depth, detected, hits, reads,
+      prefetched * sector / 1e6, wasted * sector / 1e6, prefetched ? 100 *
+      wasted / prefetched : 0);
+}
+
+/* This function plans every job from the source, with and without
+ * read-ahead depth stripes deep, and prints the report. */
+void runreadahead(struct jobsrc *src, unsigned depth)
+{
+    unsigned disk, i;
+    unsigned long job, stripelen;
+    int havearray;
+    struct dskarray array;
+    struct job jb;
+    struct ioplan plan, pfplan;
+    struct stream *s;
+    struct stripeplan *sp;
+    struct entry *e;
+
+    memset(disks, 0, sizeof disks);
+    dsks = 0;
+    detected = reads = hits = 0;
+    prefetched = wasted = 0;
+    capacity = 0;
+    maps = NULL;
+    havearray = 0;
+
+    if ((buffer = (struct entry *) malloc(STREAMS * 2 * depth * sizeof
+      *buffer)) == NULL) {
+        fprintf(stderr, "Could not get memory for the read-ahead "
+          "buffer.\n");
+        exit(46);
+    }
+
+    initioplan(&plan);
+    initioplan(&pfplan);
+    plan.model = costmodel;
+
+    for (job = 1; src->next(src, &jb) == 0; ++job) {
+        if (planraidreq(&jb.array, &jb.req, &plan)) {
+            fprintf(stderr, "Could not plan the RAID request; "
+              "skipped.\n");
+            continue;
+        }
+
+        if (jb.array.datadsks + 1 > MAXDISKS) {
+            fprintf(stderr, "Too many disks to keep account of.\n");
+            exit(47);
+        }
+        if (jb.array.datadsks + 1 > dsks) dsks = jb.array.datadsks + 1;
+
+        if (!havearray || memcmp(&array, &jb.array, sizeof array)) {
+            array = jb.array;
+            resetbuffer(&array, depth);
+            havearray = 1;
+        }
+
+        stripelen = array.datadsks * array.stripingunit;
+
+        for (sp = plan.sreqs; sp < plan.sreqs + plan.sreqcount; ++sp) {
+            e = (jb.req.nature == READREQ) ? lookup(sp->offset /
+              stripelen) : NULL;
+
+            if (jb.req.nature == READREQ) ++reads;
+            if (e) {
+                ++hits;
+                secmapset(e->used, sp->offset % stripelen /
+                  ARRAYSECTOR(&array), sp->len / ARRAYSECTOR(&array));
+            }
+
+            for (disk = 0; disk <= array.datadsks; ++disk)
+                for (i = 0; i < 2; ++i)
+                    if ((i ? sp->wr : sp->rd)[disk].len) {
+                        ++disks[disk].ops;
+                        disks[disk].bytes += (i ? sp->wr :
+                          sp->rd)[disk].len;
+                        if (e == NULL) {
+                            ++disks[disk].raops;
+                            disks[disk].rabytes += (i ? sp->wr :
+                              sp->rd)[disk].len;
+                        }
+                    }
+        }
+
+        if (jb.req.nature == READREQ && (s = follow(jb.req.offset,
+          jb.req.len, job)) != NULL)
+            readahead(&array, s, depth, &pfplan);
+    }
+
+    for (i = 0; i < capacity; ++i) evict(&buffer[i]);
+
+    freeioplan(&plan);
+    freeioplan(&pfplan);
+
+    report(depth, havearray ? ARRAYSECTOR(&array) : SECTOR);
+
+    free((void *) buffer);
+    free((void *) maps);
+}
+
+/* vim: set cindent shiftwidth=4 expandtab: */
@@ -1,497 +1,232 @@
-#include <assert.h>
-
-#include "reqsim.h"
-
-struct stripereq {
-    unsigned offset; /* Absolute offset; a 64-bit value in practice. */
-    unsigned len;    /* 32 bits should be adequate in practice. */
-};
+#ifdef PROFILE
+/* Clocks are a POSIX matter. */
+#define _POSIX_C_SOURCE 200112L
+#include <time.h>
+#endif
 
-/* Offset and length matter all the way down to stripe units. The
- * properties need to be made explicit primarily because stripe requests
- * are free to begin and end anywhere in a stripe unit (but not anywhere
- * in a sector, which is assumed by the simulator). */
-struct unitscope {
-    unsigned offset;
-    unsigned len;
-};
-
-/* Scope table: an experimental means of scalably recording stripe unit
- * scope. When scope is recorded for groups of stripe units, we need a
- * maximum of only 5 entries for any situation. */
-struct scopetab {
-    /* Scope of the first request unit. */
-    struct unitscope req1;
-    /* When there are two or more request units, scope of the final
-     * request unit. Otherwise, req2.len must be 0. */
-    struct unitscope req2;
-    /* When there are three or more request units, scope of units between
-     * the first request unit and the final one. Otherwise, req3.len must
-     * be 0. */
-    struct unitscope req3;
-    /* Scope of off-request stripe units, that is, data units not part of
-     * the request. */
-    struct unitscope offreq;
-    /* Scope of the parity unit. */
-    struct unitscope parity;
-};
+#include "simint.h"
 
 /* A selection of jobs are built into the simulator. Some are defined
  * statically, while other are generated dynamically, that is, at
  * run-time. When DYNAMIC is defined, the simulator sources its jobs from
  * the generator indicated by JOBSRC. Otherwise, JOBSRC indicates a
- * particular job list.*/
+ * particular job list. Both may be given on the command line of the
+ * compiler instead, as "make check" does.*/
+#ifndef JOBSRC
 #define DYNAMIC
 #define JOBSRC 2
+#endif
 
 /* Built-in jobs are accessed through one of these. */
 extern struct joblist jblist[];
 extern unsigned (*jbgen[])(struct job **);
 
-static struct dskarray *array; /* The current disk array. */
-static struct raidreq *rreq;   /* The current RAID request. */
-static struct stripereq *sreq; /* The current stripe request. */
-/* A relative number indicating the first and final stripe units of the
- * request. */
-static unsigned firstunit, finalunit;
-/* The number of stripe units in the stripe request. Only data units are
- * counted. */
-static unsigned requnits;
-/* Physical stripe number. In single-level RAID configurations, the
- * physical number is the same as a stripe's logical number. */
-static unsigned stripe;
-/* The fault (flt) status (stat) of the current stripe (s). A value of
- * FLTFREE means the stripe is fault-free. Any other value indicates that
- * one the stripe's units falls on a faulty disk. If the value equals
- * PARITY_UNIT, then it is the parity unit. Otherwise, the the value is
- * the number of the unfortunate data unit.*/
-static int fltstats;
-
-#define PARITY_UNIT -2
-
-/* This function maps disks to stripe units. For RAID4 arrays, it is an
- * identity function. For RAID5, left-symmetric placement is assumed. */
-static unsigned disktounit(unsigned disk)
-{
-    return (array->lvl == RAID4) ? disk : (disk + stripe) %
-      (array->datadsks + 1);
-}
-
-/* This function expands a RAID request to one or more stripe requests. */
-static unsigned expandraidreq(struct stripereq **stripereqs)
-{
-    unsigned extlen, nextoffset, reqcount, stripelen;
-    struct stripereq *req;
-
-    /* We are interested in the stripe length without the parity unit, in
-     * other words, the length of the logical stripe. */
-    stripelen = array->datadsks * array->stripingunit;
-
-    /* Extended length: RAID request length + the stripe-relative offset.
-     * This limits alignment uncertainty to one end of the request without
-     * affecting the number of stripe requests. */
-    extlen = rreq->len + rreq->offset % stripelen;
-    reqcount = extlen / stripelen;
-    if (extlen - reqcount * stripelen) ++reqcount;
-
-    req = *stripereqs = (struct stripereq *) malloc(reqcount * sizeof
-      (struct stripereq));
-
-    if (*stripereqs == NULL) {
-        fprintf(stderr, "Could not get memory for expanding the RAID "
-          "request.\n");
-        exit(1);
-    }
-
-    /* The first stripe request. */
-    req->offset = rreq->offset;
-    req->len = (reqcount == 1) ? rreq->len : stripelen - rreq->offset %
-      stripelen;
+/* The query server (server.c). */
+extern int servestdio();
+extern int servesocket(const char *path);
 
-    if (reqcount > 1) {
-        nextoffset = req->offset + req->len;
+/* The pipeline (pipeline.c). */
+extern void runpipeline(struct jobsrc *src);
 
-        /* Stripe requests between the first and the last, if there are
-         * any. */
-        for (++req; req < *stripereqs + reqcount - 1; ++req) {
-            req->offset = nextoffset;
-            req->len = stripelen;
-            nextoffset += stripelen;
-        }
-
-        /* The last stripe request. */
-        req->offset = nextoffset;
-        req->len = rreq->len - (*stripereqs)->len - (reqcount - 2) *
-          stripelen;
-    }
+/* The in-memory data path (datapath.c). */
+extern void rundatapath(struct jobsrc *src);
 
-    return reqcount;
-}
-
-/* This function fills a string according to the given unit scope. Sectors
- * of the stripe unit taking part in the request are represented by 'x' in
- * the scope string, and remaining sectors appear as ' '. */
-static char *visualisescope(struct unitscope *scope, char *scopestr)
-{
-    unsigned sector, sectors;
+/* The file-backed array (filearray.c). */
+extern void runfilearray(struct jobsrc *src, const char *prefix);
 
-    /* Clear the string first. */
-    for (sector = 0; sector < array->stripingunit / SECTOR; ++sector)
-        scopestr[sector] = ' ';
+/* The load accounts (load.c). */
+extern void runload(struct jobsrc *src, double percent);
 
-    /* Identify sectors in the scope. */
-    sector = scope->offset / SECTOR;
-    for (sectors = scope->len / SECTOR; sectors; --sectors)
-        scopestr[sector++] = 'x';
-
-    /* The string is echoed for a return value to permit visualisescope to
-     * be called in a printf call, etc.. */ 
-    return scopestr;
-}
-
-/* This function prints unit scopes for the same stripe request together
- * on one line separated by '|' characters and followed by the final
- * number of bytes required for each disk. The scopes follow disk, or
- * physical, order. */
-static void printscopeline(struct scopetab *scopes)
-{
-    /* Scope string used as a source for the final scope line. Never
-     * printed whole. In contrast to the final product, here stripe unit
-     * scopes are kept in logical unit order. */
-    char *scopestr;
-    unsigned bytes;       /* All unit scope lengths together, in bytes. */
-    unsigned disk;        /* Which disk. */
-    unsigned strlen;      /* Length of the scope string. */
-    unsigned unit;        /* Stripe unit. */
-    unsigned unitsectors; /* Sectors in the striping unit. */
-
-    unitsectors = array->stripingunit / SECTOR;
-
-    /* No need for a null character at the end, as scopestr will never
-     * be printed whole. */
-    strlen = (array->datadsks + 1) * unitsectors;
-    if ((scopestr = (char *) malloc(strlen)) == NULL) {
-        fprintf(stderr, "Could not get memory for printing the scope "
-          "line.\n");
-        exit(2);
-    }
-    memset(scopestr, ' ', strlen);
-
-    bytes = 0;
-
-    if (scopes->req1.len) {
-        visualisescope(&scopes->req1, scopestr + firstunit * unitsectors);
-
-        bytes += scopes->req1.len;
-    }
+/* The time series (series.c). */
+extern void runseries(struct jobsrc *src, unsigned long len);
 
-    if (scopes->req3.len)
-        for (unit = firstunit + 1; unit < finalunit; ++unit) {
-            /* Reconstruct-read is the only request service method which
-             * may give a group scope (req3) even as one of the member
-             * units is faulty. */
-            if (unit == fltstats) continue;
+/* The reshape (reshape.c). */
+extern void runreshape(struct jobsrc *src, unsigned long capacity);
 
-            visualisescope(&scopes->req3, scopestr + unit * unitsectors);
+/* The flash translation layer model (ftl.c). */
+extern void runftl(struct jobsrc *src, unsigned long capacity);
 
-            bytes += scopes->req3.len;
-        }
+/* Sampled replay (sample.c). */
+extern void runsample(struct jobsrc *src, unsigned long samples);
 
-    if (scopes->req2.len) {
-        visualisescope(&scopes->req2, scopestr + finalunit * unitsectors);
+/* The background scrub (scrub.c). */
+extern void runscrub(struct jobsrc *src, unsigned long capacity, double
+  rate);
 
-        bytes += scopes->req2.len;
-    }
+/* The stripe lock model (stripelock.c). */
+extern void runstripelocks(struct jobsrc *src, unsigned granularity, int
+  merge);
 
-    if (scopes->offreq.len) {
-        for (unit = 0; unit < firstunit; ++unit)
-            visualisescope(&scopes->offreq, scopestr + unit *
-              unitsectors);
+/* The read-ahead model (readahead.c). */
+extern void runreadahead(struct jobsrc *src, unsigned depth);
 
-        for (unit = finalunit + 1; unit < array->datadsks; ++unit)
-            visualisescope(&scopes->offreq, scopestr + unit *
-              unitsectors);
+/* The optimality oracle (oracle.c). */
+extern void runoracle(unsigned threads);
 
-        bytes += (array->datadsks - requnits) * scopes->offreq.len;
-    }
+/* The binary trace converter (bintrace.c). */
+extern void convertbin(FILE *in, const char *path);
 
-    if (scopes->parity.len) {
-        visualisescope(&scopes->parity, scopestr + array->datadsks *
-          unitsectors);
+/* The cost model writes are planned by, if any (see struct ioplan). Used
+ * by every way of running the jobs. */
+const struct devmodel *costmodel;
 
-        bytes += scopes->parity.len;
-    }
+/* Entries in the reconstructed-unit cache reads are planned with, if any
+ * (see struct ioplan). */
+static unsigned rrentries;
 
-    /* The final scope line is constructed by sourcing scope information
-     * from scopestr and dynamically inserting '|' . */
-    for (disk = 0; disk <= array->datadsks; ++disk) {
-        unit = disktounit(disk);
-        printf("|%.*s", unitsectors, scopestr + unit * unitsectors);
-    }
+/* Data units in the known-zero map stripe requests are planned with, if
+ * any (see struct ioplan). */
+static unsigned zerounits;
 
-    printf("| %d bytes\n", bytes);
+/* Self-profiling. When PROFILE is defined, the serial simulator times its
+ * phases: getting jobs from the source, expanding RAID requests into
+ * stripe requests, planning the stripe requests, printing job headers,
+ * and printing scope lines. A breakdown is printed on standard error at
+ * the end. Time is counted in cycles of the time-stamp counter on x86
+ * with GCC or Clang, and in nanoseconds otherwise. Without PROFILE, none
+ * of this is compiled in. */
+#ifdef PROFILE
+enum phase {SOURCEPHASE, EXPANDPHASE, PLANPHASE, HEADERPHASE, SCOPEPHASE,
+  PHASES};
 
-    free((void *) scopestr);
-}
+static unsigned long phaseticks[PHASES], phasecalls[PHASES];
 
-/* Nonredundant-write stripe request service method. */
-static void nwmethod(struct scopetab *inscopes)
+static unsigned long ticks()
 {
-    struct scopetab outscopes = {{0, 0}};
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+    unsigned hi, lo;
 
-    printscopeline(&outscopes);
-}
+    __asm__ __volatile__ ("rdtsc" : "=a" (lo), "=d" (hi));
 
-/* Read-modify-write stripe request service method. The purpose of the
- * andprint parameter is to suppress printing when only the function's
- * return value is desired, namely when verifying read-modify-write is
- * indeed more efficient than reconstruct-write in cases where the fomrer
- * is considered the primary choice. This is needed in order to develop
- * trust in the rmw-rw cut-off confition. See processwrite. */
-static unsigned rmwmethod(struct scopetab *inscopes, int andprint)
-{
-    struct scopetab outscopes = *inscopes;
-
-    if (requnits == 1)
-        outscopes.parity = outscopes.req1;
-    else {
-        outscopes.parity.offset = 0;
-        outscopes.parity.len = array->stripingunit;
-    }
+    return (unsigned long) hi << 16 << 16 | lo;
+#else
+    struct timespec ts;
 
-    if (andprint) printscopeline(&outscopes);
+    clock_gettime(CLOCK_MONOTONIC, &ts);
 
-    return outscopes.req1.len +
-      outscopes.req2.len +
-      outscopes.req3.len * (requnits - 2) +
-      outscopes.parity.len;
+    return ts.tv_sec * 1000000000UL + ts.tv_nsec;
+#endif
 }
 
-/* Reconstruct-write stripe request service method. See the comment in
- * front of rmwmethod. */
-static unsigned rwmethod(struct scopetab *inscopes, int andprint)
+static double seconds()
 {
-    struct scopetab outscopes = {{0, 0}};
-
-    if (requnits == 1)
-        /* For XOR to work, there need to be at least two data disks. With
-         * one request unit, we can be sure there is at least one unit
-         * left off request. */
-        outscopes.offreq = inscopes->req1;
-    else {
-        if (inscopes->req1.len < array->stripingunit) 
-            /* Read the first unit's scope complement. */
-            /* The default offset (0) is adequate. */
-            outscopes.req1.len = inscopes->req1.offset;
-        if (inscopes->req2.len < array->stripingunit) {
-            /* Read the final unit's scope complement. */
-            outscopes.req2.offset = inscopes->req2.len;
-            outscopes.req2.len = array->stripingunit - inscopes->req2.len;
-        }
-        /* With more than one request unit, we cannot be sure there are
-         * any units left off request. */
-        if (requnits < array->datadsks)
-            /* The default offset (0) is adequate. */
-            outscopes.offreq.len = array->stripingunit;
-    }
+    struct timespec ts;
 
-    if (andprint) printscopeline(&outscopes);
+    clock_gettime(CLOCK_MONOTONIC, &ts);
 
-    return outscopes.req1.len +
-      outscopes.req2.len +
-      outscopes.offreq.len * (array->datadsks - requnits);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
 }
 
-/* Reconstruct-write-plus stripe request service method. Unlike the other
- * methods, this one is original. It is based on a mathematically-derived
- * parity function. Optimal over read-modify-write and reconstruct-write
- * in certain cases (see the condition for the rw+ branch in
- * processwrite). */
-static void rwplusmethod(struct scopetab *inscopes)
-{
-    struct scopetab outscopes = {{0, 0}};
-    struct unitscope complement; /* Faulty unit scope complement. */
-
-    if (fltstats == firstunit) {
-        complement.offset = 0;
-        complement.len = inscopes->req1.offset;
-        if (inscopes->req2.len == array->stripingunit)
-            outscopes.req2 = complement;
-        else
-            /* The default offset (0) is adequate. */
-            outscopes.req2.len = array->stripingunit;
-        if (requnits < array->datadsks)
-            outscopes.offreq = inscopes->req1;
-    }
-    else
-    {
-        complement.offset = inscopes->req2.len;
-        complement.len = array->stripingunit - complement.offset;
-        if (inscopes->req1.len == array->stripingunit)
-            outscopes.req1 = complement;
-        else
-            /* The default offset (0) is adequate. */
-            outscopes.req1.len = array->stripingunit;
-        if (requnits < array->datadsks)
-            outscopes.offreq = inscopes->req2;
-    }
-    if (requnits > 2)
-        outscopes.req3 = complement;
-    outscopes.parity = complement;
-
-    printscopeline(&outscopes);
-}
+#define PROFILED(phase, stmt) do { \
+    unsigned long start_ = ticks(); \
+    stmt; \
+    phaseticks[phase] += ticks() - start_; \
+    ++phasecalls[phase]; \
+} while (0)
+#else
+#define PROFILED(phase, stmt) stmt
+#endif
 
-/* This function chooses the appropriate stripe request service method for
- * writes. */
-static void processwrite(struct scopetab *inscopes)
+static struct dskarray *array; /* The current disk array. */
+static struct raidreq *rreq;   /* The current RAID request. */
+/* The sector size of the current array, and what sectorshift says about
+ * it. */
+static unsigned sector, secshift;
+
+/* Stripe requests printed in full at either end of a RAID request, or 0
+ * for all of them. Those in between are summed up in one line apiece in
+ * the job header and among the scope lines, and are never formatted. */
+static unsigned elide;
+
+/* This function tells how many stripe requests of a plan are elided; the
+ * first of them is number elide. */
+static unsigned elided(struct ioplan *plan)
 {
-    unsigned primary, secondary;
-
-    if (fltstats == FLTFREE) {
-        /* The rmw-rw cut-off condition referred to in various places. It
-         * is a request lengh mark where read-modify-write becomes more
-         * efficient than reconstruct-write or vice versa. requnits != 1
-         * does not represent any extra knowledge. It is added only so we
-         * can have two branches instead of four. */
-        if (requnits == 1 && array->datadsks > 3 || requnits != 1 &&
-          array->stripingunit * (array->datadsks - 1) > 2 * sreq->len) {
-            primary = rmwmethod(inscopes, 1);
-            secondary = rwmethod(inscopes, 0);
-        }
-        else {
-            secondary = rmwmethod(inscopes, 0);
-            primary = rwmethod(inscopes, 1);
-        }
-        assert(primary <= secondary);
-    }
-    else if (fltstats == PARITY_UNIT)
-        nwmethod(inscopes);
-    /* If an off-request unit is faulty. */
-    else if (fltstats < firstunit || fltstats > finalunit)
-        rmwmethod(inscopes, 1);
-    /* If there is one request unit, or the faulty unit changes
-     * completely. */
-    else if (requnits == 1 || fltstats > firstunit && fltstats < finalunit
-      || fltstats == firstunit && inscopes->req1.len ==
-      array->stripingunit || fltstats == finalunit && inscopes->req2.len
-      == array->stripingunit)
-        rwmethod(inscopes, 1);
-    else
-        /* There are two or more request units, and the faulty unit
-         * changes partially. */
-        rwplusmethod(inscopes);
+    return (elide && plan->sreqcount > 2 * elide) ? plan->sreqcount - 2 *
+      elide : 0;
 }
 
-/* Direct-read stripe request service method. Old method, new name. */
-static void drmethod(struct scopetab *inscopes)
+/* This function prints the read scopes of a stripe request plan together
+ * on one line separated by '|' characters and followed by the final
+ * number of bytes required for each disk, and by the partly written
+ * sectors read-modify-written, if any. The scopes follow disk, or
+ * physical, order. Sectors of a stripe unit taking part in the request
+ * are represented by 'x', and remaining sectors appear as ' '. */
+static void printscopeline(struct stripeplan *plan)
 {
-    printscopeline(inscopes);
-}
+    /* Sector bitmap of the whole stripe, one stretch of words per disk,
+     * followed by the scope string for one disk. The string is never
+     * printed whole, so it needs no null character at the end. The
+     * storage is kept from one line to the next and only ever grows. */
+    static unsigned long *map;
+    static size_t mapsize;
+    void *mem;
+    char *scopestr;
+    size_t size;
+    unsigned disk;        /* Which disk. */
+    unsigned dskwords;    /* Words in the bitmap of one disk. */
+    unsigned unitsectors; /* Sectors in the striping unit. */
 
-/* Reconstruct-read stripe request service method. */
-static void rrmethod(struct scopetab *inscopes)
-{
-    struct scopetab outscopes = {{0, 0}};
-    struct unitscope fltscope; /* Faulty unit scope. */
+    unitsectors = TOSECTORS(array->stripingunit, sector, secshift);
+    dskwords = SECMAPWORDS(unitsectors);
 
-    if (requnits > 1) {
-        if (fltstats != firstunit) {
-            outscopes.req1.offset = 0;
-            outscopes.req1.len = array->stripingunit;
-        }
-        if (requnits > 2 && (fltstats == firstunit || fltstats ==
-          finalunit) || requnits > 3) {
-            outscopes.req3.offset = 0;
-            outscopes.req3.len = array->stripingunit;
-        }
-        if (fltstats != finalunit) {
-            outscopes.req2.offset = 0;
-            outscopes.req2.len = array->stripingunit;
+    size = (array->datadsks + 1) * dskwords * sizeof *map + unitsectors;
+    if (size > mapsize) {
+        if ((mem = realloc((void *) map, size)) == NULL) {
+            fprintf(stderr, "Could not get memory for printing the scope "
+              "line.\n");
+            exit(2);
         }
+        map = (unsigned long *) mem;
+        mapsize = size;
     }
+    scopestr = (char *) (map + (array->datadsks + 1) * dskwords);
 
-    if (fltstats == firstunit)
-        fltscope = inscopes->req1;
-    else if (fltstats < finalunit)
-        fltscope = inscopes->req3;
-    else
-        fltscope = inscopes->req2;
+    secmapclear(map, (array->datadsks + 1) * dskwords * SECMAPBITS);
 
-    if (requnits < array->datadsks)
-        outscopes.offreq = fltscope;
+    for (disk = 0; disk <= array->datadsks; ++disk)
+        secmapset(map + disk * dskwords, TOSECTORS(plan->rd[disk].offset,
+          sector, secshift), TOSECTORS(plan->rd[disk].len, sector,
+          secshift));
 
-    outscopes.parity = fltscope;
+    for (disk = 0; disk <= array->datadsks; ++disk) {
+        secmaprender(map + disk * dskwords, 0, unitsectors, scopestr);
+        printf("|%.*s", unitsectors, scopestr);
+    }
 
-    printscopeline(&outscopes);
+    printf("| %d bytes", secmapcount(map, (array->datadsks + 1) *
+      dskwords) * sector);
+    if (plan->partial)
+        printf(", %s sector%s read-modify-written", (plan->partial == 3) ?
+          "first and last" : (plan->partial & 1) ? "first" : "last",
+          (plan->partial == 3) ? "s" : "");
+    putchar('\n');
 }
 
-/* This function chooses the appropriate stripe request service method for
- * reads. */
-static void processread(struct scopetab *inscopes)
+/* This function prints the line standing for the elided stripe requests
+ * of a plan: how many there are, and the bytes they read and write on
+ * every disk. */
+static void printelided(struct ioplan *plan)
 {
-    if (fltstats >= firstunit && fltstats <= finalunit)
-        /* A request unit is faulty. */
-        rrmethod(inscopes);
-    else
-        /* The stripe is fault-free, or either the parity unit or an
-         * off-request unit is faulty. */
-        drmethod(inscopes);
-}
+    unsigned disk;
+    unsigned long rd, wr;
+    struct stripeplan *end, *sp;
 
-/* This function does preliminary processing of the current stripe
- * request, then calls one of two request nature-specific functions to
- * continue the work. In particular, processreq figures out the number of
- * request units as well as the first and final request units, translates
- * a single offset-length pair into a bunch of scopes, and finally sets up
- * the stripe fault status. */
-static void processreq()
-{
-    /* Extended length concept as in expandraidreq only here for a stripe
-     * request rather than a RAID one. */
-    unsigned extlen;
-    /* Request offset relative to the stripe (s) and the first request
-     * unit (u), respectively. */
-    unsigned sreloffset;
-    unsigned ureloffset;
-    struct scopetab inscopes = {{0, 0}};
-
-    sreloffset = sreq->offset - stripe * (array->datadsks *
-      array->stripingunit);
-    firstunit = sreloffset / array->stripingunit;
-    ureloffset = sreloffset - firstunit * array->stripingunit;
-
-    extlen = sreq->len + ureloffset;
-    requnits = extlen / array->stripingunit;
-    if (extlen - requnits * array->stripingunit) ++requnits;
-
-    finalunit = firstunit + requnits - 1;
-
-    inscopes.req1.offset = ureloffset;
-    inscopes.req1.len = (requnits == 1) ? sreq->len : array->stripingunit
-      - inscopes.req1.offset;
-
-    if (requnits > 1) {
-        /* The default offset (0) is adequate. */
-        inscopes.req2.len = sreq->len - inscopes.req1.len - (requnits - 2)
-          * array->stripingunit;
-
-        if (requnits > 2)
-            /* The default offset (0) is adequate. */
-            inscopes.req3.len = array->stripingunit;
-    }
+    end = plan->sreqs + elide + elided(plan);
+
+    printf("  %u stripe requests elided, bytes read / written by disk:",
+      elided(plan));
 
-    if (array->fltstata == FLTFREE)
-        fltstats = FLTFREE;
-    else {
-        fltstats = disktounit(array->fltstata);
-        if (fltstats == array->datadsks) fltstats = PARITY_UNIT;
+    for (disk = 0; disk <= array->datadsks; ++disk) {
+        rd = wr = 0;
+        for (sp = plan->sreqs + elide; sp < end; ++sp) {
+            rd += sp->rd[disk].len;
+            wr += sp->wr[disk].len;
+        }
+        printf(" %lu/%lu", rd, wr);
     }
 
-    if (rreq->nature == WRITEREQ)
-        processwrite(&inscopes);
-    else
-        processread(&inscopes);
+    putchar('\n');
 }
 
 /* This function rotates a string of length len left by units positions.
@@ -547,7 +282,7 @@ static void colourandprint(char *str, unsigned strlen, unsigned
     char const *CTAG = "\x1B[0m", *FTAG = "\x1B[41m", *PTAG = "\x1B[33m";
 
     /* The number of sectors in the striping unit, a common derivative. */
-    unitsectors = array->stripingunit / SECTOR;
+    unitsectors = TOSECTORS(array->stripingunit, sector, secshift);
 
     /* Rotation of the stripe. For RAID5, assuming (1) the left-symmetric
      * mapping, and (2) an ordinary single-level array configuration. */
@@ -648,19 +383,20 @@ static void colourandprint(char *str, unsigned strlen, unsigned
  * see the array's configuration, and there is highlighting for each
  * stripe's parity as well as the optional faulty disk in the array.
  * Stripe units (the columns) follow disk order. */
-static void printjobheader(unsigned reqcount, struct stripereq *reqs)
+static void printjobheader(struct ioplan *plan)
 {
-    unsigned index, offset, pos, stops[3], stripelen, strlen;
+    unsigned index, pos, stops[3], stripelen, strlen, unitend,
+      unitsectors;
     char actionsymbol, symboltouse;
     char *next, *str;
-    struct stripereq *curr;
+    struct stripeplan *curr;
 
     /* One character for each sector in the stripe, including the parity
      * disk, one character before each disk to signal the start of a new
      * disk, and one character after the last disk for aesthetics. No
      * terminating \0 at the end. */
-    strlen = (array->datadsks + 1) * (array->stripingunit / SECTOR + 1)
-      + 1;
+    unitsectors = TOSECTORS(array->stripingunit, sector, secshift);
+    strlen = (array->datadsks + 1) * (unitsectors + 1) + 1;
 
     if ((str = (char *) malloc(strlen)) == NULL) {
         fprintf(stderr, "Could not get memory for the job header source "
@@ -669,17 +405,18 @@ static void printjobheader(unsigned reqcount, struct stripereq *reqs)
     }
 
     /* The left and right borders for the last disk, respectively. */
-    str[array->datadsks * (array->stripingunit / SECTOR + 1)] = '|';
+    str[array->datadsks * (unitsectors + 1)] = '|';
     str[strlen - 1] = '|';
 
     /* A symbol representing the action performed on the array. */
-    actionsymbol = (rreq->nature == WRITEREQ) ? 'w' : 'r';
+    actionsymbol = (rreq->nature == WRITEREQ) ? 'w' : (rreq->nature ==
+      DISCARDREQ) ? 'd' : 'r';
 
     /* The stripe length without the parity disk, a commonly-used
      * derivative. */
     stripelen = array->datadsks * array->stripingunit;
 
-    curr = reqs; /* We are at the first stripe request. */
+    curr = plan->sreqs; /* We are at the first stripe request. */
 
     /* A stripe request conceptually divides a stripe into three zones,
      * the request area and two blocks of optional space around it.
@@ -691,14 +428,19 @@ static void printjobheader(unsigned reqcount, struct stripereq *reqs)
     stops[1] = stops[0] + curr->len;
     stops[2] = stripelen;
 
+    /* Every unit begins with a border. Tracking where the next unit
+     * begins saves a division per sector. */
     next = str;
-    pos = 0;
+    pos = unitend = 0;
 
     for (index = 0; index < 3; ++index) {
         symboltouse = (index == 1) ? actionsymbol : ' ';
 
-        for (; pos < stops[index]; pos += SECTOR) {
-            if (pos % array->stripingunit == 0) *next++ = '|';
+        for (; pos < stops[index]; pos += sector) {
+            if (pos == unitend) {
+                *next++ = '|';
+                unitend += array->stripingunit;
+            }
 
             *next++ = symboltouse;
         }
@@ -706,13 +448,24 @@ static void printjobheader(unsigned reqcount, struct stripereq *reqs)
 
     colourandprint(str, strlen, curr->offset);
 
-    if (reqcount > 1) {
+    if (plan->sreqcount > 1) {
         /* Stripe requests second to penultimate, if any. */
-        while (++curr < reqs + reqcount - 1) {
+        while (++curr < plan->sreqs + plan->sreqcount - 1) {
+            if (curr == plan->sreqs + elide && elided(plan)) {
+                printf("  ... %u stripe requests elided ...\n",
+                  elided(plan));
+                curr += elided(plan) - 1;
+                continue;
+            }
+
             next = str;
+            unitend = 0;
 
-            for (pos = 0; pos < stripelen; pos += SECTOR) {
-                if (pos % array->stripingunit == 0) *next++ = '|';
+            for (pos = 0; pos < stripelen; pos += sector) {
+                if (pos == unitend) {
+                    *next++ = '|';
+                    unitend += array->stripingunit;
+                }
 
                 *next++ = actionsymbol;
             }
@@ -724,7 +477,7 @@ static void printjobheader(unsigned reqcount, struct stripereq *reqs)
         stops[1] = curr->len;
 
         next = str;
-        pos = 0;
+        pos = unitend = 0;
 
         /* Notice how index begins at 1 this time. For the final stripe
          * request, we know the middle zone begins at the start of the
@@ -732,8 +485,11 @@ static void printjobheader(unsigned reqcount, struct stripereq *reqs)
         for (index = 1; index < 3; ++index) {
             symboltouse = (index == 1) ? actionsymbol : ' ';
 
-            for (; pos < stops[index]; pos += SECTOR) {
-                if (pos % array->stripingunit == 0) *next++ = '|';
+            for (; pos < stops[index]; pos += sector) {
+                if (pos == unitend) {
+                    *next++ = '|';
+                    unitend += array->stripingunit;
+                }
 
                 *next++ = symboltouse;
             }
@@ -745,57 +501,472 @@ static void printjobheader(unsigned reqcount, struct stripereq *reqs)
     free((void *) str);
 }
 
-/* This function obtains one or more jobs from our built-in selection,
- * then for each one sets the current array and RAID request, and expands
- * the latter into one or more stripe requests, which are then run through
- * the simulator. */
-static void loadstripereq()
+/* The built-in selection of jobs as a job source. */
+struct builtinsrc {
+    struct jobsrc src;
+    struct job *jobs;
+    struct job *next;
+    unsigned left;
+};
+
+static int nextbuiltinjob(struct jobsrc *src, struct job *jb)
+{
+    struct builtinsrc *bs = (struct builtinsrc *) src;
+
+    if (bs->left == 0) return -1;
+
+    --bs->left;
+    *jb = *bs->next++;
+
+    return 0;
+}
+
+static void closebuiltinsrc(struct jobsrc *src)
 {
-    unsigned jbcount, sreqcount;
-    struct job *jb, *jobs;
-    struct stripereq *sreqs;
+#ifdef DYNAMIC
+    free((void *) ((struct builtinsrc *) src)->jobs);
+#endif
+    free((void *) src);
+}
+
+/* This function obtains one or more jobs from our built-in selection and
+ * offers them as a job source. */
+static struct jobsrc *openbuiltinsrc()
+{
+    struct builtinsrc *bs;
+
+    if ((bs = (struct builtinsrc *) malloc(sizeof *bs)) == NULL) {
+        fprintf(stderr, "Could not get memory for a job source.\n");
+        exit(12);
+    }
 
 #ifdef DYNAMIC
-    jbcount = (*jbgen[JOBSRC])(&jobs);
+    bs->left = (*jbgen[JOBSRC])(&bs->jobs);
 #else
-    jbcount = jblist[JOBSRC].jbcount;
-    jobs = jblist[JOBSRC].list;
+    bs->left = jblist[JOBSRC].jbcount;
+    bs->jobs = jblist[JOBSRC].list;
 #endif
 
-    jb = jobs;
+    bs->src.next = nextbuiltinjob;
+    bs->src.close = closebuiltinsrc;
+    bs->next = bs->jobs;
 
-    while (jbcount--) {
-        array = &jb->array;
-        rreq = &jb->req;
-        ++jb;
+    return &bs->src;
+}
 
-        sreqcount = expandraidreq(&sreqs);
+/* This function prints the simulation of one job: the job header, then
+ * the read scopes of every stripe request. */
+void renderjob(struct job *jb, struct ioplan *plan)
+{
+    unsigned sreqnum;
 
-        printjobheader(sreqcount, sreqs);
-        putchar('\n');
+    array = &jb->array;
+    rreq = &jb->req;
+    sector = ARRAYSECTOR(array);
+    secshift = sectorshift(array);
 
-        stripe = rreq->offset / (array->datadsks * array->stripingunit);
-        sreq = sreqs;
-        while (sreqcount--) {
-            processreq();
+    PROFILED(HEADERPHASE, printjobheader(plan));
+    putchar('\n');
 
-            ++sreq;
-            ++stripe;
+    for (sreqnum = 0; sreqnum < plan->sreqcount; ++sreqnum)
+        if (sreqnum == elide && elided(plan)) {
+            PROFILED(SCOPEPHASE, printelided(plan));
+            sreqnum += elided(plan) - 1;
         }
+        else
+            PROFILED(SCOPEPHASE, printscopeline(&plan->sreqs[sreqnum]));
 
-        putchar('\n'); /* A new line before the next header. */
+    putchar('\n'); /* A new line before the next header. */
+}
 
-        free((void *) sreqs);
+/* What the plans of a run add up to, for the reports at the end. */
+static struct {
+    unsigned long overruled, partials, rrhits, rrs, rrsaved, sreqs, writes,
+      zerohits, zerosaved;
+    double saved;
+} totals;
+
+/* This function readies a plan for a run: it sets the cost model and
+ * attaches a reconstructed-unit cache and a known-zero map if they were
+ * asked for. The totals start over. */
+void attachplan(struct ioplan *plan)
+{
+    plan->model = costmodel;
+    if (rrentries && (plan->cache = newrrcache(rrentries)) == NULL) {
+        fprintf(stderr, "Could not get memory for the reconstructed-unit "
+          "cache.\n");
+        exit(33);
+    }
+    if (zerounits && (plan->zeros = newzeromap(zerounits)) == NULL) {
+        fprintf(stderr, "Could not get memory for the known-zero map.\n");
+        exit(51);
     }
 
-#ifdef DYNAMIC 
-    free((void *) jobs);
+    memset(&totals, 0, sizeof totals);
+}
+
+/* This function gives back what attachplan attached to a plan. */
+void detachplan(struct ioplan *plan)
+{
+    freerrcache(plan->cache);
+    freezeromap(plan->zeros);
+    plan->cache = NULL;
+    plan->zeros = NULL;
+}
+
+/* This function adds a job's plan to the totals. */
+void addtotals(const struct job *jb, const struct ioplan *plan)
+{
+    unsigned sreqnum;
+
+    totals.sreqs += plan->sreqcount;
+
+    if (jb->req.nature == WRITEREQ) totals.writes += plan->sreqcount;
+    totals.partials += plan->partials;
+    totals.overruled += plan->overruled;
+    totals.saved += plan->saved;
+    totals.rrhits += plan->rrhits;
+    totals.rrsaved += plan->rrsaved;
+    totals.zerohits += plan->zerohits;
+    totals.zerosaved += plan->zerosaved;
+    for (sreqnum = 0; sreqnum < plan->sreqcount; ++sreqnum)
+        if (plan->sreqs[sreqnum].method == RRMETHOD) ++totals.rrs;
+}
+
+/* This function reports on standard error what the partly written sectors
+ * cost, and what the reconstructed-unit cache, the known-zero map and
+ * the cost model saved, those of them in use. */
+void reporttotals()
+{
+    if (totals.partials)
+        fprintf(stderr, "%lu partly written sectors were "
+          "read-modify-written.\n", totals.partials);
+
+    if (rrentries)
+        fprintf(stderr, "The reconstructed-unit cache served %lu of %lu "
+          "reconstruct-reads, saving %lu bytes read.\n", totals.rrhits,
+          totals.rrhits + totals.rrs, totals.rrsaved);
+
+    if (zerounits)
+        fprintf(stderr, "The known-zero map trimmed the reads of %lu of "
+          "%lu stripe requests, saving %lu bytes read.\n", totals.zerohits,
+          totals.sreqs, totals.zerosaved);
+
+    if (costmodel)
+        fprintf(stderr, "The cost model chose differently from the byte "
+          "count for %lu of %lu write stripe requests, saving an "
+          "estimated %.6f s.\n", totals.overruled, totals.writes,
+          totals.saved);
+}
+
+/* This function takes jobs from the source one at a time, plans each RAID
+ * request, and prints the result, then the totals (see reporttotals). */
+static void loadstripereq(struct jobsrc *src)
+{
+    int failed, more;
+    struct job jb;
+    struct ioplan plan;
+#ifdef PROFILE
+    static const char *names[PHASES] = {"source", "expand", "plan",
+      "header", "scopes"};
+    unsigned long total;
+    unsigned phase;
+    double start, elapsed;
+#endif
+
+    initioplan(&plan);
+    attachplan(&plan);
+#ifdef PROFILE
+    start = seconds();
 #endif
+
+    for (;;) {
+        PROFILED(SOURCEPHASE, more = src->next(src, &jb) == 0);
+        if (!more) break;
+
+        PROFILED(EXPANDPHASE, failed = expandioplan(&jb.array, &jb.req,
+          &plan));
+        if (failed) {
+            fprintf(stderr, "Could not plan the RAID request; "
+              "skipped.\n");
+            continue;
+        }
+        PROFILED(PLANPHASE, planioplan(&jb.array, jb.req.nature, &plan));
+
+        renderjob(&jb, &plan);
+        addtotals(&jb, &plan);
+    }
+
+    detachplan(&plan);
+    freeioplan(&plan);
+
+#ifdef PROFILE
+    elapsed = seconds() - start;
+    if (elapsed <= 0) elapsed = 1e-9;
+
+    total = 0;
+    for (phase = 0; phase < PHASES; ++phase) total += phaseticks[phase];
+    if (total == 0) total = 1;
+
+    fprintf(stderr, "%-8s %12s %16s %7s %12s\n", "phase", "calls",
+      "ticks", "share", "ticks/call");
+    for (phase = 0; phase < PHASES; ++phase)
+        fprintf(stderr, "%-8s %12lu %16lu %6.1f%% %12.1f\n", names[phase],
+          phasecalls[phase], phaseticks[phase], 100.0 * phaseticks[phase] /
+          total, phasecalls[phase] ? (double) phaseticks[phase] /
+          phasecalls[phase] : 0);
+    fprintf(stderr, "%lu stripe requests in %.6f s: %.0f stripe "
+      "requests/s, %.1f ns each\n", totals.sreqs, elapsed, totals.sreqs /
+      elapsed, totals.sreqs ? elapsed * 1e9 / totals.sreqs : 0);
+#endif
+
+    reporttotals();
+}
+
+/* This function explains how the program is to be run. */
+static void usage(const char *prog)
+{
+    fprintf(stderr, "usage: %s [-p | -x | -f prefix | -l percent | "
+      "-w window | -r size | -u size [-v rate] | -g size | -m samples | "
+      "-a depth | -q stripes [-j]] [-c model] [-k entries] [-z units] "
+      "[-e stripes] [-t trace] | "
+      "-b binary [-t trace] | -o threads | "
+      "-s [socket] [-c model] [-k entries] [-z units]\n", prog);
+    fprintf(stderr,
+      "  (none)      run the built-in jobs\n"
+      "  -t trace    run the jobs in a file of text request records, or\n"
+      "              a binary trace (- for text on standard input)\n"
+      "  -p          run in a pipeline of threads, one per stage\n"
+      "  -x          execute the plans on an in-memory array and check\n"
+      "              the outcome\n");
+    fprintf(stderr,
+      "  -f prefix   replay the plans on the files prefix0, prefix1 ...\n"
+      "              and report the throughput\n"
+      "  -l percent  report the load on every disk, by region and by\n"
+      "              window, flagging more than percent per cent of it\n"
+      "  -w window   print a time series of the trace, with windows\n"
+      "              window microseconds long\n");
+    fprintf(stderr,
+      "  -r size     grow the array by a disk while running the jobs,\n"
+      "              migrating size megabytes of data\n"
+      "  -u size     scrub size megabytes of the array while running the\n"
+      "              jobs, rate (100) stripes a second, throttled\n"
+      "  -g size     model the flash of drives of size megabytes beneath\n"
+      "              the disks, and report write amplification\n"
+      "  -m samples  estimate what replaying a binary trace gives from\n"
+      "              so many records drawn at random\n");
+    fprintf(stderr,
+      "  -a depth    read ahead of sequential streams, depth stripes\n"
+      "              deep, and report the disk operations saved\n"
+      "  -q stripes  run the jobs at once under stripe locks, one per so\n"
+      "              many stripes, and report the contention; -j merges\n"
+      "              the parity updates of writes queued on a stripe\n");
+    fprintf(stderr,
+      "  -c model    plan writes by the hdd or ssd cost model rather\n"
+      "              than by bytes read\n"
+      "  -k entries  plan reads with a cache of reconstructed units,\n"
+      "              entries stripes large, when printing or serving\n"
+      "              the plans\n");
+    fprintf(stderr,
+      "  -z units    plan with a map of the first units data units known\n"
+      "              to hold zeros, all of them at first, when printing\n"
+      "              or serving the plans\n"
+      "  -e stripes  print only so many stripe requests at either end of\n"
+      "              a RAID request, summing up the rest\n");
+    fprintf(stderr,
+      "  -b binary   convert a text trace, or blkparse output, from\n"
+      "              standard input or -t into a binary trace\n"
+      "  -o threads  check the service methods chosen against a model of\n"
+      "              the sectors needed, on threads threads\n"
+      "  -s          serve text request records on standard input\n"
+      "  -s socket   serve them on a Unix domain socket\n");
+    exit(11);
 }
 
 int main(int argc, char *argv[])
 {
-    loadstripereq();
+    int arg, datapath, merge, pipelined, printing, serving;
+    unsigned depth, granularity, threads;
+    unsigned long capacity, flash, samples, scrub, window;
+    double percent, rate;
+    const char *binary, *prefix, *sockpath, *trace;
+    FILE *file;
+    struct jobsrc *src;
+
+    datapath = merge = pipelined = serving = 0;
+    binary = prefix = sockpath = trace = NULL;
+    percent = 0;
+    capacity = flash = samples = scrub = window = 0;
+    depth = granularity = 0;
+    rate = 0;
+
+    for (arg = 1; arg < argc; ++arg)
+        if (strcmp(argv[arg], "-s") == 0) {
+            serving = 1;
+            if (arg + 1 < argc && argv[arg + 1][0] != '-')
+                sockpath = argv[++arg];
+        }
+        else if (strcmp(argv[arg], "-o") == 0 && argc == 3) {
+            if ((threads = strtoul(argv[2], NULL, 10)) == 0)
+                usage(argv[0]);
+            runoracle(threads);
+            return 0;
+        }
+        else if (strcmp(argv[arg], "-p") == 0)
+            pipelined = 1;
+        else if (strcmp(argv[arg], "-x") == 0)
+            datapath = 1;
+        else if (strcmp(argv[arg], "-f") == 0 && arg + 1 < argc)
+            prefix = argv[++arg];
+        else if (strcmp(argv[arg], "-l") == 0 && arg + 1 < argc) {
+            if ((percent = atof(argv[++arg])) <= 0 || percent > 100)
+                usage(argv[0]);
+        }
+        else if (strcmp(argv[arg], "-w") == 0 && arg + 1 < argc) {
+            if ((window = strtoul(argv[++arg], NULL, 10)) == 0)
+                usage(argv[0]);
+        }
+        else if (strcmp(argv[arg], "-r") == 0 && arg + 1 < argc) {
+            /* Offsets are 32 bits wide. */
+            if ((capacity = strtoul(argv[++arg], NULL, 10)) == 0 ||
+              capacity > 4095)
+                usage(argv[0]);
+            capacity <<= 20;
+        }
+        else if (strcmp(argv[arg], "-u") == 0 && arg + 1 < argc) {
+            if ((scrub = strtoul(argv[++arg], NULL, 10)) == 0 || scrub >
+              4095)
+                usage(argv[0]);
+            scrub <<= 20;
+        }
+        else if (strcmp(argv[arg], "-v") == 0 && arg + 1 < argc) {
+            if ((rate = atof(argv[++arg])) <= 0)
+                usage(argv[0]);
+        }
+        else if (strcmp(argv[arg], "-g") == 0 && arg + 1 < argc) {
+            /* Offsets on a disk are 32 bits wide. */
+            if ((flash = strtoul(argv[++arg], NULL, 10)) == 0 || flash >
+              4095)
+                usage(argv[0]);
+            flash <<= 20;
+        }
+        else if (strcmp(argv[arg], "-m") == 0 && arg + 1 < argc) {
+            if ((samples = strtoul(argv[++arg], NULL, 10)) == 0)
+                usage(argv[0]);
+        }
+        else if (strcmp(argv[arg], "-a") == 0 && arg + 1 < argc) {
+            if ((depth = strtoul(argv[++arg], NULL, 10)) == 0)
+                usage(argv[0]);
+        }
+        else if (strcmp(argv[arg], "-q") == 0 && arg + 1 < argc) {
+            if ((granularity = strtoul(argv[++arg], NULL, 10)) == 0)
+                usage(argv[0]);
+        }
+        else if (strcmp(argv[arg], "-j") == 0)
+            merge = 1;
+        else if (strcmp(argv[arg], "-c") == 0 && arg + 1 < argc) {
+            if (strcmp(argv[++arg], "hdd") == 0)
+                costmodel = &hddmodel;
+            else if (strcmp(argv[arg], "ssd") == 0)
+                costmodel = &ssdmodel;
+            else
+                usage(argv[0]);
+        }
+        else if (strcmp(argv[arg], "-e") == 0 && arg + 1 < argc) {
+            if ((elide = strtoul(argv[++arg], NULL, 10)) == 0)
+                usage(argv[0]);
+        }
+        else if (strcmp(argv[arg], "-z") == 0 && arg + 1 < argc) {
+            if ((zerounits = strtoul(argv[++arg], NULL, 10)) == 0)
+                usage(argv[0]);
+        }
+        else if (strcmp(argv[arg], "-k") == 0 && arg + 1 < argc) {
+            if ((rrentries = strtoul(argv[++arg], NULL, 10)) == 0)
+                usage(argv[0]);
+        }
+        else if (strcmp(argv[arg], "-b") == 0 && arg + 1 < argc)
+            binary = argv[++arg];
+        else if (strcmp(argv[arg], "-t") == 0 && arg + 1 < argc)
+            trace = argv[++arg];
+        else
+            usage(argv[0]);
+
+    /* The ways of running the jobs exclude one another. Merging is of
+     * stripe locks, and the rate is that of the scrub. */
+    if ((capacity != 0) + (scrub != 0) + (flash != 0) + (samples != 0) +
+      (depth != 0) + (granularity != 0) + (window != 0) + (percent != 0) +
+      (prefix != NULL) + datapath + pipelined + (binary != NULL) + serving >
+      1)
+        usage(argv[0]);
+    if (merge && granularity == 0 || rate && scrub == 0 || serving && trace)
+        usage(argv[0]);
+
+    /* Only the plans printed, serially or in a pipeline, or served are
+     * made with a cache of reconstructed units or a known-zero map. */
+    printing = !(capacity || scrub || flash || samples || depth ||
+      granularity || window || percent || prefix || datapath || binary ||
+      serving);
+    if ((rrentries || zerounits) && !printing && !serving) usage(argv[0]);
+    if (rate == 0) rate = 100;
+
+    if (serving) return sockpath ? servesocket(sockpath) : servestdio();
+
+    file = NULL;
+    src = NULL;
+
+    if (trace && strcmp(trace, "-") && (binary || (src =
+      openbinsrc(trace)) == NULL) && (file = fopen(trace, "r")) == NULL) {
+        fprintf(stderr, "Could not open %s.\n", trace);
+        exit(13);
+    }
+
+    /* Sampling needs a binary trace to draw records from. */
+    if (samples && src == NULL) {
+        fprintf(stderr, "Sampling takes a binary trace (-t).\n");
+        exit(44);
+    }
+
+    if (binary) {
+        convertbin(file ? file : stdin, binary);
+        if (file) fclose(file);
+        return 0;
+    }
+
+    /* Unless a binary trace was found. */
+    if (file)
+        src = opentextsrc(file);
+    else if (trace && strcmp(trace, "-") == 0)
+        src = opentextsrc(stdin);
+    else if (trace == NULL)
+        src = openbuiltinsrc();
+
+    if (capacity)
+        runreshape(src, capacity);
+    else if (scrub)
+        runscrub(src, scrub, rate);
+    else if (flash)
+        runftl(src, flash);
+    else if (samples)
+        runsample(src, samples);
+    else if (depth)
+        runreadahead(src, depth);
+    else if (granularity)
+        runstripelocks(src, granularity, merge);
+    else if (window)
+        runseries(src, window);
+    else if (percent)
+        runload(src, percent);
+    else if (prefix)
+        runfilearray(src, prefix);
+    else if (datapath)
+        rundatapath(src);
+    else if (pipelined)
+        runpipeline(src);
+    else
+        loadstripereq(src);
+
+    src->close(src);
+    if (file) fclose(file);
 
     return 0;
 }
@@ -12,17 +12,26 @@ struct dskarray {
      * FLTFREE means the array is fault-free. Any other value is the
      * number of the disk considered faulty.*/
     int fltstata;
+    /* Sector size in bytes. A value of 0 means SECTOR, so that arrays
+     * which do not mention it keep the size the simulator always had. */
+    unsigned sector;
 };
 
 #define FLTFREE -1
 
-enum reqnature {READREQ, WRITEREQ};
+/* A discard tells the array that the data of a range is no longer
+ * needed. Only whole stripes are discarded, as parity would have to be
+ * brought up to date for less; a discard reads and writes nothing, and
+ * is planned as nonredundant-write. Less than a stripe is ignored. */
+enum reqnature {READREQ, WRITEREQ, DISCARDREQ};
 
 struct raidreq {
     enum reqnature nature;
     unsigned offset; /* Absolute offset; a 64-bit value in practice. */
     unsigned len;    /* Not sure if more than 32 bits are ever needed in
                         practice. */
+    unsigned long time; /* Arrival time in microseconds, for requests
+                           taken from timestamped traces; 0 otherwise. */
 };
 
 /* Simulation job: a disk array specification together with a RAID request
@@ -39,4 +48,168 @@ struct joblist {
 
 #define SECTOR 512
 
+/* The sector size of an array, the number of sectors in some number of
+ * bytes, and how far into its sector a byte offset lies. secshift is what
+ * sectorshift (libreqsim.c) returns for the array: the base 2 logarithm
+ * of the sector size where it is a power of two, as it is for 512-byte
+ * (and 512e) and 4Kn drives, and 0 otherwise. Common sizes thus cost a
+ * shift or a mask rather than a division. */
+#define ARRAYSECTOR(array) ((array)->sector ? (array)->sector : SECTOR)
+#define TOSECTORS(bytes, sector, secshift) ((secshift) ? (bytes) >> \
+  (secshift) : (bytes) / (sector))
+#define SECTOROFF(bytes, sector, secshift) ((secshift) ? (bytes) & \
+  ((sector) - 1) : (bytes) % (sector))
+
+/* Offset and length matter all the way down to stripe units. The
+ * properties need to be made explicit primarily because stripe requests
+ * are free to begin and end anywhere in a stripe unit (but not anywhere
+ * in a sector, which is assumed by the simulator). */
+struct unitscope {
+    unsigned offset;
+    unsigned len;
+};
+
+/* Stripe request service methods: nonredundant-write, read-modify-write,
+ * reconstruct-write, reconstruct-write-plus, direct-read and
+ * reconstruct-read, respectively. */
+enum svcmethod {NWMETHOD, RMWMETHOD, RWMETHOD, RWPLUSMETHOD, DRMETHOD,
+  RRMETHOD};
+
+/* I/O plan for a stripe request. The rd and wr members each point to one
+ * scope per disk, datadsks + 1 in all, following disk (physical) order.
+ * A scope of length 0 means the disk is not touched. Offsets in rd and wr
+ * are relative to the start of the stripe unit on that disk. */
+struct stripeplan {
+    unsigned offset;    /* The stripe request, as part of the RAID */
+    unsigned len;       /* request. */
+    unsigned stripe;    /* Physical stripe number. */
+    enum svcmethod method;
+    struct unitscope *rd;
+    struct unitscope *wr;
+    unsigned rdbytes, wrbytes;
+    unsigned rdops, wrops; /* The number of disks read and written. */
+    /* Partial sectors. When a RAID request does not begin or end on a
+     * sector boundary, the stripe request is widened to whole sectors,
+     * and a write has to read-modify-write the sectors it only partly
+     * covers. Bit 0 is set if the first sector of the stripe request is
+     * such a sector, and bit 1 if the last one is. The reads needed are
+     * part of rd. */
+    unsigned partial;
+};
+
+/* Device cost model. Disks are taken to spend opcost seconds on every
+ * operation, seeking and waiting for the platter on a hard disk or
+ * processing the command on a flash drive, and to move bandwidth bytes
+ * per second. Up to queues operations are worked on at once, which hides
+ * the overhead of all but one in queues operations; a hard disk has one
+ * queue, while a flash drive has as many as it has channels. inflight is
+ * the number of stripe requests the array is taken to be serving at once,
+ * 1 meaning this one alone: the busier the array, the more the disks a
+ * plan keeps busy count, next to how long its own operations take. */
+struct devmodel {
+    double opcost;
+    double bandwidth;
+    unsigned queues;
+    unsigned inflight;
+};
+
+/* Presets for 7200 rpm hard disks and SATA flash drives. */
+extern const struct devmodel hddmodel, ssdmodel;
+
+/* Reconstructed-unit cache (libreqsim.c), remembering, for as many
+ * stripes as it has entries, what of the faulty unit has been rebuilt.
+ * newrrcache returns NULL if memory could not be obtained. A cache may be
+ * shared by plans used one after another, but not by plans used at the
+ * same time. */
+struct rrcache;
+
+struct rrcache *newrrcache(unsigned entries);
+void freerrcache(struct rrcache *cache);
+
+/* Known-zero map (libreqsim.c), recording, for the first units data
+ * units of the array, counting by offset, which are known to hold zeros:
+ * at first all of them, as on a freshly provisioned or thin-provisioned
+ * volume. A unit written is no longer known to be zero, and the units of
+ * a stripe discarded are again. newzeromap returns NULL if memory could
+ * not be obtained. A map may be shared by plans used one after another,
+ * but not by plans used at the same time, and starts over when used with
+ * another array. */
+struct zeromap;
+
+struct zeromap *newzeromap(unsigned units);
+void freezeromap(struct zeromap *zeros);
+
+/* I/O plan for a RAID request: one stripe plan per stripe request, plus
+ * totals. Initialise with initioplan before first use. A plan may be
+ * passed to planraidreq any number of times; storage is reused. */
+struct ioplan {
+    unsigned sreqcount;
+    struct stripeplan *sreqs;
+    unsigned rdbytes, wrbytes;
+    unsigned rdops, wrops;
+    unsigned partials; /* Sectors read-modify-written. */
+    /* The cost model writes are planned by. NULL, the default, means
+     * read-modify-write and reconstruct-write are chosen between by the
+     * number of bytes read. Otherwise, of the service methods able to
+     * serve a write stripe request, the one expected to complete first is
+     * chosen. overruled counts the stripe requests for which this is not
+     * the method the byte count would have chosen, and saved is the time
+     * this is expected to save, in seconds. */
+    const struct devmodel *model;
+    unsigned overruled;
+    double saved;
+    /* The reconstructed-unit cache reads are planned with, if any (see
+     * newrrcache). With a cache, a read stripe request whose faulty unit
+     * was reconstructed by an earlier one, and not written since, reads
+     * the other request units under direct-read and nothing else. rrhits
+     * counts such stripe requests, and rrsaved the bytes they would have
+     * read under reconstruct-read but did not. */
+    struct rrcache *cache;
+    unsigned rrhits, rrsaved;
+    /* The known-zero map stripe requests are planned with, if any (see
+     * newzeromap). With a map, nothing is read from a data unit known to
+     * be zero, nor from the parity unit of a stripe whose data units all
+     * are, as zeros add nothing to parity; the service methods are chosen
+     * as without it. zerohits counts the stripe requests which so read
+     * less, and zerosaved the bytes they did not read. */
+    struct zeromap *zeros;
+    unsigned zerohits, zerosaved;
+    /* Stripe requests are planned by a kernel specialised for the array's
+     * geometry where the library was built with one (see GEOMETRIES in
+     * the Makefile). Nonzero generic has them planned by the generic
+     * kernel all the same, which gives the same plans, only slower. */
+    int generic;
+    /* Storage behind sreqs and the scopes. Not for the user. */
+    unsigned sreqcap, scopecap;
+    struct unitscope *scopes;
+};
+
+/* The library (libreqsim.c). planraidreq and planstripereq return 0 on
+ * success, and -1 if the job is not something the simulator can deal
+ * with or, for planraidreq, if memory could not be obtained. RAID
+ * requests may begin and end anywhere; stripe requests given to
+ * planstripereq must be whole sectors. To plan a
+ * single stripe request, fill in offset and len and point rd and wr at
+ * datadsks + 1 scopes each. planraidreq is expandioplan, which only
+ * breaks the RAID request into stripe requests, followed by planioplan,
+ * which plans each of them; the two may be called separately.
+ * disktime is the time a disk takes to carry out ops operations moving
+ * bytes bytes in all under a cost model, and plantime the time a stripe
+ * plan is expected to take: its reads, then its writes, or, on a busy
+ * array, its share of the work of the disks, whichever is longer. */
+unsigned sectorshift(const struct dskarray *array);
+double disktime(const struct devmodel *model, unsigned ops, double bytes);
+double plantime(const struct devmodel *model, const struct dskarray *array,
+  const struct stripeplan *plan);
+void initioplan(struct ioplan *plan);
+void freeioplan(struct ioplan *plan);
+int planraidreq(const struct dskarray *array, const struct raidreq *rreq,
+  struct ioplan *plan);
+int expandioplan(const struct dskarray *array, const struct raidreq *rreq,
+  struct ioplan *plan);
+void planioplan(const struct dskarray *array, enum reqnature nature,
+  struct ioplan *plan);
+int planstripereq(const struct dskarray *array, enum reqnature nature,
+  struct stripeplan *plan);
+
 /* vim: set cindent shiftwidth=4 expandtab: */
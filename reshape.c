@@ -0,0 +1,169 @@
+#include "simint.h"
+
+/* This file simulates growing an array by a disk while it serves the jobs
+ * of a trace. The disk added becomes disk datadsks + 1, and the data
+ * migrates to the new geometry one stripe of the new geometry at a time,
+ * from the start of the array onwards: the data is read as planned for
+ * the old array and written, parity and all, as planned for the new one.
+ * As a new stripe holds more data than an old one, it is always made of
+ * old stripes at or after its own place, which have been read by then.
+ * Behind the boundary, the data is in the new geometry, and requests for
+ * it are planned for the new array; ahead of the boundary, for the old
+ * one. A request straddling the boundary is split in two.
+ *
+ * Disks are timed by their clocks (diskclock.c) under the cost model,
+ * hddmodel unless another is chosen. Migration steps follow one another,
+ * and requests arrive at their times. The same requests are also timed on
+ * the old array alone, to tell what the reshape costs them. */
+
+static const struct devmodel *model;
+
+/* This function plans a request and times it on the disks, starting no
+ * earlier than at. The time it is done is returned. */
+static double timereq(double *clock, const struct dskarray *array, const
+  struct raidreq *req, struct ioplan *plan, double at)
+{
+    if (planraidreq(array, req, plan)) {
+        fprintf(stderr, "Could not plan a request during the reshape.\n");
+        exit(30);
+    }
+
+    return chargeplan(model, clock, array->datadsks + 1, plan, at);
+}
+
+/* This function carries out migration step step, starting no earlier
+ * than at: the new stripe of that number is read from the old array and
+ * written to the new one. The time it is done is returned, and the bytes
+ * moved are added to *rdbytes and *wrbytes. */
+static double migrate(double *clock, const struct dskarray *old, const
+  struct dskarray *new, unsigned long step, struct ioplan *plan, double
+  at, double *rdbytes, double *wrbytes)
+{
+    struct raidreq stripe;
+
+    stripe.nature = READREQ;
+    stripe.len = new->datadsks * new->stripingunit;
+    stripe.offset = step * stripe.len;
+    stripe.time = 0;
+
+    at = timereq(clock, old, &stripe, plan, at);
+    *rdbytes += plan->rdbytes;
+
+    stripe.nature = WRITEREQ;
+    at = timereq(clock, new, &stripe, plan, at);
+    *rdbytes += plan->rdbytes;
+    *wrbytes += plan->wrbytes;
+
+    return at;
+}
+
+/* Foreground latency, summed. */
+struct latency {
+    unsigned long reqs;
+    double grown, alone; /* With the reshape, and on the old array. */
+};
+
+/* This function grows the array the jobs are made against by one disk,
+ * migrating capacity bytes of data, rounded up to whole stripes of the
+ * new geometry, and reports on the reshape. */
+void runreshape(struct jobsrc *src, unsigned long capacity)
+{
+    unsigned long boundary, step, steps, stripelen;
+    double alone[MAXDISKS], grown[MAXDISKS];
+    double at, done, end, next, rdbytes, wrbytes;
+    int havearray;
+    struct dskarray new, old;
+    struct job jb;
+    struct ioplan plan;
+    struct latency after, during, *lat;
+    struct raidreq part;
+
+    model = costmodel ? costmodel : &hddmodel;
+
+    memset(alone, 0, sizeof alone);
+    memset(grown, 0, sizeof grown);
+    memset(&after, 0, sizeof after);
+    memset(&during, 0, sizeof during);
+    initioplan(&plan);
+
+    havearray = 0;
+    step = steps = stripelen = 0;
+    next = rdbytes = wrbytes = 0;
+
+    while (src->next(src, &jb) == 0) {
+        if (!havearray) {
+            if (jb.array.datadsks + 2 > MAXDISKS) {
+                fprintf(stderr, "Too many disks to grow the array.\n");
+                exit(31);
+            }
+
+            old = new = jb.array;
+            ++new.datadsks;
+            stripelen = new.datadsks * new.stripingunit;
+            steps = (capacity + stripelen - 1) / stripelen;
+            havearray = 1;
+        }
+        else if (memcmp(&jb.array, &old, sizeof old)) {
+            fprintf(stderr, "A reshape is simulated against a single "
+              "array.\n");
+            exit(32);
+        }
+
+        at = jb.req.time / 1e6;
+
+        /* The migration steps due by the time the request arrives. */
+        for (; step < steps && next <= at; ++step)
+            next = migrate(grown, &old, &new, step, &plan, next, &rdbytes,
+              &wrbytes);
+
+        /* The request, split at the boundary. */
+        boundary = step * stripelen;
+        part = jb.req;
+        done = at;
+        if (part.offset < boundary) {
+            if (part.len > boundary - part.offset)
+                part.len = boundary - part.offset;
+            done = timereq(grown, &new, &part, &plan, at);
+            part.offset += part.len;
+            part.len = jb.req.len - part.len;
+        }
+        if (part.len && (end = timereq(grown, &old, &part, &plan, at)) >
+          done)
+            done = end;
+
+        lat = (step < steps) ? &during : &after;
+        ++lat->reqs;
+        lat->grown += done - at;
+        lat->alone += timereq(alone, &old, &jb.req, &plan, at) - at;
+    }
+
+    if (!havearray) {
+        freeioplan(&plan);
+        return;
+    }
+
+    /* The steps left once the jobs have run out. */
+    for (; step < steps; ++step)
+        next = migrate(grown, &old, &new, step, &plan, next, &rdbytes,
+          &wrbytes);
+
+    freeioplan(&plan);
+
+    printf("Reshape from %u to %u data disks, %lu stripes of %lu bytes:\n"
+      "  done at %.6f s, reading %.3f MB and writing %.3f MB\n",
+      old.datadsks, new.datadsks, steps, stripelen, next, rdbytes / 1e6,
+      wrbytes / 1e6);
+
+    if (during.reqs)
+        printf("  %lu requests during the reshape: mean latency %.6f s, "
+          "against %.6f s without, a slowdown of %.2f\n", during.reqs,
+          during.grown / during.reqs, during.alone / during.reqs,
+          during.alone ? during.grown / during.alone : 0);
+
+    if (after.reqs)
+        printf("  %lu requests after the reshape: mean latency %.6f s, "
+          "against %.6f s on the old array\n", after.reqs, after.grown /
+          after.reqs, after.alone / after.reqs);
+}
+
+/* vim: set cindent shiftwidth=4 expandtab: */
@@ -0,0 +1,288 @@
+#include <math.h>
+
+#include "simint.h"
+
+/* This file estimates what replaying a binary trace would give from a
+ * random sample of its records, for traces too long to replay whole.
+ * Records are drawn uniformly at random, with replacement, straight from
+ * the trace (see binsrcseek), and planned one at a time. The estimates
+ * are stratified after the fact: records are put in strata by nature,
+ * read, write or discard, and by size class (up to 4 KiB, 16 KiB, 64 KiB,
+ * 256 KiB, 1 MiB, and more), the size of every stratum is counted in one
+ * pass over the trace beforehand, which takes no planning, and the total
+ * of a stratum is estimated from the mean of its sample. A stratum the
+ * sample has missed is left out, and the records so left out are
+ * reported.
+ *
+ * Estimated are the bytes requested, none by discards, which move no
+ * data, and the bytes read and written on the disks, in all and per disk,
+ * the stripe requests given to every service method, and the
+ * amplification, that is, bytes on the disks per byte requested, all with
+ * 95 per cent confidence intervals. A line of
+ * the main estimates is printed every time the sample doubles, from
+ * FIRSTREPORT on, so the intervals can be watched narrowing; the full
+ * estimates follow at the end. */
+
+#define CLASSES 6
+#define STRATA (3 * CLASSES)
+#define FIRSTREPORT 1000
+
+/* The standard normal quantile for 95 per cent confidence. */
+#define Z95 1.96
+
+/* What is measured of every job sampled: bytes requested, bytes on the
+ * disks, stripe requests per service method, and bytes per disk. */
+#define REQBYTES 0
+#define DSKBYTES 1
+#define METHODS 2
+#define DISKS (METHODS + RRMETHOD + 1)
+#define METRICS (DISKS + MAXDISKS)
+
+struct stratum {
+    unsigned long size;    /* Records in the trace. */
+    unsigned long n;       /* Records in the sample. */
+    double sum[METRICS], sumsq[METRICS];
+    double cross;          /* Sum of bytes requested times bytes on the
+                              disks, for the amplification. */
+};
+
+static struct stratum strata[STRATA];
+
+static unsigned long seed;
+
+/* A linear congruential generator, as rand may give as few as 15 bits. */
+static unsigned long nextrandom()
+{
+    seed = (seed * 1103515245UL + 12345) & 0xffffffffUL;
+
+    return seed;
+}
+
+/* A random record number below records, long traces included. */
+static unsigned long pickrecord(unsigned long records)
+{
+    unsigned long r;
+
+    r = nextrandom() >> 8;
+    r = r << 8 << 8 ^ nextrandom() >> 8;
+
+    return r % records;
+}
+
+static unsigned stratumof(const struct raidreq *req)
+{
+    unsigned class;
+    unsigned long limit;
+
+    for (class = 0, limit = 4096; class < CLASSES - 1 && req->len > limit;
+      ++class)
+        limit *= 4;
+
+    return ((req->nature == DISCARDREQ) ? 2 : req->nature == WRITEREQ) *
+      CLASSES + class;
+}
+
+/* This function estimates the total of a metric over the trace, putting
+ * the half-width of its confidence interval in *ci. */
+static double estimate(unsigned metric, double *ci)
+{
+    double mean, total, var, variance;
+    const struct stratum *st;
+
+    total = variance = 0;
+
+    for (st = strata; st < strata + STRATA; ++st) {
+        if (st->n == 0) continue;
+
+        mean = st->sum[metric] / st->n;
+        total += st->size * mean;
+
+        if (st->n > 1) {
+            var = (st->sumsq[metric] - st->n * mean * mean) / (st->n - 1);
+            variance += (double) st->size * st->size * var / st->n;
+        }
+    }
+
+    *ci = Z95 * sqrt(variance > 0 ? variance : 0);
+
+    return total;
+}
+
+/* This function estimates the amplification, a ratio of two totals,
+ * putting the half-width of its confidence interval in *ci. */
+static double amplification(double *ci)
+{
+    double dev, dsk, ratio, req, variance;
+    const struct stratum *st;
+
+    req = estimate(REQBYTES, &dev);
+    dsk = estimate(DSKBYTES, &dev);
+    ratio = req ? dsk / req : 0;
+
+    variance = 0;
+
+    for (st = strata; st < strata + STRATA; ++st) {
+        if (st->n < 2) continue;
+
+        /* The sample variance of dsk - ratio * req within the stratum. */
+        dev = st->sumsq[DSKBYTES] - 2 * ratio * st->cross + ratio * ratio *
+          st->sumsq[REQBYTES] - (st->sum[DSKBYTES] - ratio *
+          st->sum[REQBYTES]) * (st->sum[DSKBYTES] - ratio *
+          st->sum[REQBYTES]) / st->n;
+        variance += (double) st->size * st->size * dev / (st->n - 1) /
+          st->n;
+    }
+
+    *ci = req ? Z95 * sqrt(variance > 0 ? variance : 0) / req : 0;
+
+    return ratio;
+}
+
+/* This function prints one line of the main estimates. */
+static void progress(unsigned long samples)
+{
+    double amp, ampci, dsk, dskci;
+
+    amp = amplification(&ampci);
+    dsk = estimate(DSKBYTES, &dskci);
+
+    printf("%10lu %14.3f %12.3f %10.4f %10.4f\n", samples, dsk / 1e6, dskci
+      / 1e6, amp, ampci);
+    fflush(stdout);
+}
+
+/* This function prints the full estimates. */
+static void report(unsigned long samples, unsigned long records, unsigned
+  dsks)
+{
+    static const char *names[RRMETHOD + 1] = {"nw", "rmw", "rw", "rw+",
+      "dr", "rr"};
+    unsigned disk, method;
+    unsigned long missed;
+    double amp, ampci, ci, sreqs, total;
+    const struct stratum *st;
+
+    missed = 0;
+    for (st = strata; st < strata + STRATA; ++st)
+        if (st->n == 0) missed += st->size;
+
+    printf("\n%lu samples of %lu records, at 95%% confidence", samples,
+      records);
+    if (missed)
+        printf("; %lu records in strata not sampled are left out",
+          missed);
+    printf(":\n");
+
+    total = estimate(REQBYTES, &ci);
+    printf("%-14s %14.3f +- %.3f MB\n", "requested", total / 1e6, ci /
+      1e6);
+    total = estimate(DSKBYTES, &ci);
+    printf("%-14s %14.3f +- %.3f MB\n", "on the disks", total / 1e6, ci /
+      1e6);
+    amp = amplification(&ampci);
+    printf("%-14s %14.4f +- %.4f\n", "amplification", amp, ampci);
+
+    for (disk = 0; disk < dsks; ++disk) {
+        total = estimate(DISKS + disk, &ci);
+        printf("disk %-9u %14.3f +- %.3f MB\n", disk, total / 1e6, ci /
+          1e6);
+    }
+
+    sreqs = 0;
+    for (method = 0; method <= RRMETHOD; ++method)
+        sreqs += estimate(METHODS + method, &ci);
+
+    for (method = 0; method <= RRMETHOD; ++method) {
+        total = estimate(METHODS + method, &ci);
+        printf("%-14s %14.0f +- %.0f stripe requests, %.2f%%\n",
+          names[method], total, ci, sreqs ? 100 * total / sreqs : 0);
+    }
+}
+
+/* This function adds a job sampled, planned, to the sample of its
+ * stratum. */
+static void measure(const struct job *jb, const struct ioplan *plan,
+  unsigned dsks)
+{
+    unsigned disk, metric;
+    double y[METRICS];
+    struct stratum *st;
+    const struct stripeplan *sp;
+
+    memset(y, 0, sizeof y);
+    y[REQBYTES] = (jb->req.nature == DISCARDREQ) ? 0 : jb->req.len;
+    y[DSKBYTES] = (double) plan->rdbytes + plan->wrbytes;
+    for (sp = plan->sreqs; sp < plan->sreqs + plan->sreqcount; ++sp) {
+        ++y[METHODS + sp->method];
+        for (disk = 0; disk < dsks; ++disk)
+            y[DISKS + disk] += (double) sp->rd[disk].len + sp->wr[disk].len;
+    }
+
+    st = &strata[stratumof(&jb->req)];
+    ++st->n;
+    for (metric = 0; metric < METRICS; ++metric) {
+        st->sum[metric] += y[metric];
+        st->sumsq[metric] += y[metric] * y[metric];
+    }
+    st->cross += y[REQBYTES] * y[DSKBYTES];
+}
+
+/* This function samples up to samples records of a binary trace, which
+ * the source must read, and prints the estimates. */
+void runsample(struct jobsrc *src, unsigned long samples)
+{
+    unsigned dsks;
+    unsigned long drawn, next, records, shown;
+    struct job jb;
+    struct ioplan plan;
+
+    memset(strata, 0, sizeof strata);
+    seed = 1;
+
+    records = binsrclen(src);
+    if (records == 0) return;
+
+    /* The strata, counted. */
+    binsrcseek(src, 0, records);
+    while (src->next(src, &jb) == 0) ++strata[stratumof(&jb.req)].size;
+
+    if (jb.array.datadsks + 1 > MAXDISKS) {
+        fprintf(stderr, "Too many disks to sample.\n");
+        exit(43);
+    }
+    dsks = jb.array.datadsks + 1;
+
+    initioplan(&plan);
+    plan.model = costmodel;
+
+    printf("# %8s %14s %12s %10s %10s\n", "samples", "disk MB", "+- MB",
+      "amp", "+-");
+
+    shown = 0;
+
+    for (drawn = 0, next = FIRSTREPORT; drawn < samples; ) {
+        binsrcseek(src, pickrecord(records), 1);
+        src->next(src, &jb);
+
+        if (planraidreq(&jb.array, &jb.req, &plan))
+            fprintf(stderr, "Could not plan the RAID request; "
+              "skipped.\n");
+        else
+            measure(&jb, &plan, dsks);
+
+        if (++drawn == next) {
+            progress(drawn);
+            shown = drawn;
+            next *= 2;
+        }
+    }
+
+    /* The last line is for the whole sample, whatever its size. */
+    if (drawn != shown) progress(drawn);
+
+    freeioplan(&plan);
+
+    report(drawn, records, dsks);
+}
+
+/* vim: set cindent shiftwidth=4 expandtab: */
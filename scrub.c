@@ -0,0 +1,217 @@
+#include "simint.h"
+
+/* This file simulates a background parity scrub running while the array
+ * serves the jobs of a trace. The scrub walks the stripes from the start
+ * of the array onwards, reading every unit of a stripe, data and parity,
+ * one stripe per step, but for the unit of a faulty disk. Steps are
+ * meant to come rate times a second. The scrub is throttled by the
+ * foreground: a step falling due while more than BUSYDEPTH requests are
+ * in flight is put off, and the interval between steps doubles, up to
+ * MAXBACKOFF times; once the array is quiet, it halves back with every
+ * step taken. A step never starts before the one ahead of it is done.
+ *
+ * Steps and requests share the disk clocks (diskclock.c), under the cost
+ * model, hddmodel unless another is chosen. The same requests are also
+ * timed without the scrub, to tell what it costs them, and the scrub
+ * without the requests, to tell what the throttling costs it. */
+
+#define BUSYDEPTH 4
+#define MAXBACKOFF 64
+/* Requests remembered to tell how many are in flight; more than this
+ * many in flight count as this many. */
+#define INFLIGHT 256
+
+static const struct devmodel *model;
+
+/* The times the last INFLIGHT requests are done, as a ring. */
+static double donetimes[INFLIGHT];
+static unsigned lastdone;
+
+/* This function plans a request and times it on the disks, starting no
+ * earlier than at. The time it is done is returned. */
+static double timereq(double *clock, const struct dskarray *array, const
+  struct raidreq *req, struct ioplan *plan, double at)
+{
+    if (planraidreq(array, req, plan)) {
+        fprintf(stderr, "Could not plan a request during the scrub.\n");
+        exit(48);
+    }
+
+    return chargeplan(model, clock, array->datadsks + 1, plan, at);
+}
+
+/* This function scrubs a stripe, starting no earlier than at, and returns
+ * the time it is done. */
+static double scrubstripe(double *clock, const struct dskarray *array,
+  double at)
+{
+    unsigned disk;
+    struct dskphase ph;
+
+    memset(&ph, 0, sizeof ph);
+
+    for (disk = 0; disk <= array->datadsks; ++disk)
+        if ((int) disk != array->fltstata) {
+            ph.ops[disk] = 1;
+            ph.bytes[disk] = array->stripingunit;
+        }
+
+    return chargephase(model, clock, array->datadsks + 1, &ph, at);
+}
+
+/* This function returns the time a scrub of steps stripes takes at rate
+ * stripes a second on idle disks, neither throttled nor held up by the
+ * foreground. */
+static double unthrottled(const struct dskarray *array, unsigned long
+  steps, double rate)
+{
+    unsigned long step;
+    double clock[MAXDISKS];
+    double done, next;
+
+    memset(clock, 0, sizeof clock);
+    done = next = 0;
+
+    for (step = 0; step < steps; ++step) {
+        done = scrubstripe(clock, array, next);
+        next = (done > next + 1 / rate) ? done : next + 1 / rate;
+    }
+
+    return done;
+}
+
+/* This function returns the number of requests in flight at a time. */
+static unsigned inflight(double at)
+{
+    unsigned depth, i;
+
+    for (depth = i = 0; i < INFLIGHT; ++i)
+        if (donetimes[i] > at) ++depth;
+
+    return depth;
+}
+
+/* Foreground latency, summed, and the longest. */
+struct latency {
+    unsigned long reqs;
+    double scrubbed, alone; /* With the scrub, and without. */
+    double maxscrubbed, maxalone;
+};
+
+/* This function scrubs capacity bytes of the array the jobs are made
+ * against, rounded up to whole stripes, at rate stripes a second, and
+ * reports on the scrub. */
+void runscrub(struct jobsrc *src, unsigned long capacity, double rate)
+{
+    unsigned backoff, maxbackoff;
+    unsigned long deferred, step, steps, stripelen;
+    double alone[MAXDISKS], scrubbed[MAXDISKS];
+    double at, done, end, next, wait;
+    int havearray;
+    struct dskarray array;
+    struct job jb;
+    struct ioplan plan;
+    struct latency after, during, *lat;
+
+    model = costmodel ? costmodel : &hddmodel;
+
+    memset(alone, 0, sizeof alone);
+    memset(scrubbed, 0, sizeof scrubbed);
+    memset(donetimes, 0, sizeof donetimes);
+    memset(&after, 0, sizeof after);
+    memset(&during, 0, sizeof during);
+    initioplan(&plan);
+
+    lastdone = 0;
+    havearray = 0;
+    step = steps = stripelen = deferred = 0;
+    backoff = maxbackoff = 1;
+    next = done = 0;
+
+    for (;;) {
+        if (src->next(src, &jb)) {
+            if (!havearray) break;
+            at = -1;
+        }
+        else {
+            if (!havearray) {
+                if (jb.array.datadsks + 1 > MAXDISKS) {
+                    fprintf(stderr, "Too many disks to scrub.\n");
+                    exit(49);
+                }
+
+                array = jb.array;
+                stripelen = array.datadsks * array.stripingunit;
+                steps = (capacity + stripelen - 1) / stripelen;
+                havearray = 1;
+            }
+            else if (memcmp(&jb.array, &array, sizeof array)) {
+                fprintf(stderr, "A scrub is simulated against a single "
+                  "array.\n");
+                exit(50);
+            }
+
+            at = jb.req.time / 1e6;
+        }
+
+        /* The steps due by the time the request arrives, or all those
+         * left once the jobs have run out. */
+        while (step < steps && (at < 0 || next <= at)) {
+            wait = backoff / rate;
+
+            if (inflight(next) > BUSYDEPTH) {
+                ++deferred;
+                if (backoff < MAXBACKOFF) backoff *= 2;
+                if (backoff > maxbackoff) maxbackoff = backoff;
+                next += backoff / rate;
+                continue;
+            }
+
+            if (backoff > 1) backoff /= 2;
+
+            done = scrubstripe(scrubbed, &array, next);
+            ++step;
+            next = (done > next + wait) ? done : next + wait;
+        }
+
+        if (at < 0) break;
+
+        end = timereq(scrubbed, &array, &jb.req, &plan, at);
+        donetimes[lastdone] = end;
+        lastdone = (lastdone + 1) % INFLIGHT;
+
+        lat = (step < steps) ? &during : &after;
+        ++lat->reqs;
+        lat->scrubbed += end - at;
+        if (end - at > lat->maxscrubbed) lat->maxscrubbed = end - at;
+        end = timereq(alone, &array, &jb.req, &plan, at) - at;
+        lat->alone += end;
+        if (end > lat->maxalone) lat->maxalone = end;
+    }
+
+    freeioplan(&plan);
+
+    if (!havearray) return;
+
+    printf("Scrub of %lu stripes of %lu bytes at %.1f stripes a second:\n"
+      "  done at %.6f s, against %.6f s unthrottled, reading %.3f MB\n"
+      "  %lu steps put off with more than %u requests in flight, the "
+      "interval growing up to %u times\n", steps, stripelen, rate, done,
+      unthrottled(&array, steps, rate), steps * (double)
+      array.stripingunit * (array.datadsks + (array.fltstata == FLTFREE)) /
+      1e6, deferred, BUSYDEPTH, maxbackoff);
+
+    if (during.reqs)
+        printf("  %lu requests during the scrub: mean latency %.6f s, "
+          "against %.6f s without, a slowdown of %.2f; at most %.6f s, "
+          "against %.6f s\n", during.reqs, during.scrubbed / during.reqs,
+          during.alone / during.reqs, during.alone ? during.scrubbed /
+          during.alone : 0, during.maxscrubbed, during.maxalone);
+
+    if (after.reqs)
+        printf("  %lu requests after the scrub: mean latency %.6f s, "
+          "against %.6f s without\n", after.reqs, after.scrubbed /
+          after.reqs, after.alone / after.reqs);
+}
+
+/* vim: set cindent shiftwidth=4 expandtab: */
@@ -0,0 +1,192 @@
+#include "simint.h"
+
+/* This file hosts packed sector bitmaps: one bit per sector, set when the
+ * sector takes part in whatever the map records. Maps are arrays of
+ * unsigned long, bit n of a map standing for sector n. Counting and
+ * rendering come in AVX2 and SSE2 flavours next to plain C ones. The
+ * flavour is picked at compile time from what the compiler is told the
+ * target supports, for example with "make SIMDFLAGS=-mavx2". */
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+/* Sectors in a word of a map. */
+#define WORDBITS SECMAPBITS
+
+void secmapclear(unsigned long *map, unsigned sectors)
+{
+    memset(map, 0, SECMAPWORDS(sectors) * sizeof *map);
+}
+
+/* This function sets count sectors starting at first. */
+void secmapset(unsigned long *map, unsigned first, unsigned count)
+{
+    unsigned long mask;
+    unsigned bit, n;
+
+    map += first / WORDBITS;
+    bit = first % WORDBITS;
+
+    while (count) {
+        n = (count < WORDBITS - bit) ? count : WORDBITS - bit;
+        mask = (n == WORDBITS) ? ~0UL : ((1UL << n) - 1) << bit;
+
+        *map++ |= mask;
+
+        count -= n;
+        bit = 0;
+    }
+}
+
+/* This function counts the bits set in one word. */
+static unsigned popcount(unsigned long word)
+{
+#ifdef __GNUC__
+    return __builtin_popcountl(word);
+#else
+    unsigned count;
+
+    for (count = 0; word; ++count) word &= word - 1;
+
+    return count;
+#endif
+}
+
+/* This function counts the sectors in a map words long. */
+unsigned secmapcount(const unsigned long *map, unsigned words)
+{
+    const unsigned char *m = (const unsigned char *) map;
+    unsigned bytes, count, i;
+
+    bytes = words * sizeof *map;
+    count = 0;
+    i = 0;
+
+#if defined(__AVX2__)
+    {
+        /* Nibble lookup with a byte shuffle, summed with SAD. */
+        const __m256i lut = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2,
+          2, 3, 2, 3, 3, 4, 0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+        const __m256i low = _mm256_set1_epi8(0x0f);
+        __m256i acc, v, n;
+        __m128i sum;
+
+        acc = _mm256_setzero_si256();
+
+        for (; i + 32 <= bytes; i += 32) {
+            v = _mm256_loadu_si256((const __m256i *) (m + i));
+            n = _mm256_add_epi8(_mm256_shuffle_epi8(lut, _mm256_and_si256(v,
+              low)), _mm256_shuffle_epi8(lut, _mm256_and_si256(
+              _mm256_srli_epi16(v, 4), low)));
+            acc = _mm256_add_epi64(acc, _mm256_sad_epu8(n,
+              _mm256_setzero_si256()));
+        }
+
+        /* Four 64-bit sums, folded to two and taken out of the register
+         * directly, whatever the width of unsigned long. */
+        sum = _mm_add_epi64(_mm256_castsi256_si128(acc),
+          _mm256_extracti128_si256(acc, 1));
+        count = _mm_cvtsi128_si32(sum) + _mm_cvtsi128_si32(_mm_srli_si128(
+          sum, 8));
+    }
+#elif defined(__SSE2__)
+    {
+        /* Bit-parallel counting within bytes, summed with SAD. */
+        const __m128i m1 = _mm_set1_epi8(0x55), m2 = _mm_set1_epi8(0x33),
+          m4 = _mm_set1_epi8(0x0f);
+        __m128i acc, v;
+
+        acc = _mm_setzero_si128();
+
+        for (; i + 16 <= bytes; i += 16) {
+            v = _mm_loadu_si128((const __m128i *) (m + i));
+            v = _mm_sub_epi8(v, _mm_and_si128(_mm_srli_epi16(v, 1), m1));
+            v = _mm_add_epi8(_mm_and_si128(v, m2), _mm_and_si128(
+              _mm_srli_epi16(v, 2), m2));
+            v = _mm_and_si128(_mm_add_epi8(v, _mm_srli_epi16(v, 4)), m4);
+            acc = _mm_add_epi64(acc, _mm_sad_epu8(v, _mm_setzero_si128()));
+        }
+
+        /* Two 64-bit sums, taken out of the register directly. */
+        count = _mm_cvtsi128_si32(acc) + _mm_cvtsi128_si32(_mm_srli_si128(
+          acc, 8));
+    }
+#endif
+
+    for (i /= sizeof *map; i < words; ++i) count += popcount(map[i]);
+
+    return count;
+}
+
+/* This function renders count sectors of a map, starting at first, into
+ * str: 'x' for a sector in the map and ' ' for one outside. No \0 is
+ * added. */
+void secmaprender(const unsigned long *map, unsigned first, unsigned
+  count, char *str)
+{
+    const unsigned char *m;
+    unsigned i;
+
+    /* Sectors up to a byte boundary, one at a time. */
+    for (; count && first % 8; ++first, --count)
+        *str++ = (map[first / WORDBITS] >> first % WORDBITS & 1) ? 'x' :
+          ' ';
+
+    /* The vector flavours look at the map a byte at a time, which is
+     * fine on the little-endian targets they exist for. */
+    m = (const unsigned char *) map + first / 8;
+    i = 0;
+
+#if defined(__AVX2__)
+    {
+        /* Each byte of the 32 bits at hand is spread over 8 lanes, and
+         * each lane then tests its own bit. */
+        const __m256i spread = _mm256_setr_epi8(0, 0, 0, 0, 0, 0, 0, 0, 1,
+          1, 1, 1, 1, 1, 1, 1, 2, 2, 2, 2, 2, 2, 2, 2, 3, 3, 3, 3, 3, 3, 3,
+          3);
+        const __m256i bits = _mm256_setr_epi8(1, 2, 4, 8, 0x10, 0x20,
+          0x40, (char) 0x80, 1, 2, 4, 8, 0x10, 0x20, 0x40, (char) 0x80, 1,
+          2, 4, 8, 0x10, 0x20, 0x40, (char) 0x80, 1, 2, 4, 8, 0x10, 0x20,
+          0x40, (char) 0x80);
+        const __m256i blank = _mm256_set1_epi8(' ');
+        const __m256i flip = _mm256_set1_epi8(' ' ^ 'x');
+        __m256i v;
+        int word;
+
+        for (; i + 32 <= count; i += 32) {
+            memcpy(&word, m + i / 8, 4);
+            v = _mm256_shuffle_epi8(_mm256_set1_epi32(word), spread);
+            v = _mm256_cmpeq_epi8(_mm256_and_si256(v, bits), bits);
+            _mm256_storeu_si256((__m256i *) (str + i), _mm256_xor_si256(
+              blank, _mm256_and_si256(v, flip)));
+        }
+    }
+#elif defined(__SSE2__)
+    {
+        const __m128i bits = _mm_set_epi8((char) 0x80, 0x40, 0x20, 0x10, 8,
+          4, 2, 1, (char) 0x80, 0x40, 0x20, 0x10, 8, 4, 2, 1);
+        const __m128i blank = _mm_set1_epi8(' ');
+        const __m128i flip = _mm_set1_epi8(' ' ^ 'x');
+        __m128i v;
+
+        for (; i + 16 <= count; i += 16) {
+            v = _mm_cvtsi32_si128(m[i / 8] | m[i / 8 + 1] << 8);
+            v = _mm_unpacklo_epi8(v, v);
+            v = _mm_unpacklo_epi16(v, v);
+            v = _mm_unpacklo_epi32(v, v);
+            v = _mm_cmpeq_epi8(_mm_and_si128(v, bits), bits);
+            _mm_storeu_si128((__m128i *) (str + i), _mm_xor_si128(blank,
+              _mm_and_si128(v, flip)));
+        }
+    }
+#endif
+
+    for (first += i; i < count; ++i, ++first)
+        str[i] = (map[first / WORDBITS] >> first % WORDBITS & 1) ? 'x' :
+          ' ';
+}
+
+/* vim: set cindent shiftwidth=4 expandtab: */
@@ -0,0 +1,102 @@
+#include "simint.h"
+
+/* This file turns a timestamped trace into a time series. Requests are
+ * planned as they come and gathered into windows of fixed length by their
+ * arrival times, and every window is summed up in one line as soon as a
+ * request arrives after it, so the series can be followed as the trace
+ * is read. A line reads
+ *
+ *     START REQS IOPS MB/S AMP NW RMW RW RW+ DR RR
+ *
+ * that is, the start of the window in seconds, the number of RAID
+ * requests arriving in it and their rate, the rate of bytes requested in
+ * megabytes per second, the amplification, that is, the bytes read and
+ * written on the disks per byte requested, discards, which move no data,
+ * requesting none, and how many stripe requests were given to each
+ * service method. A run of windows in which nothing arrives is summed up
+ * in a single line,
+ *
+ *     # START WINDOWS empty
+ *
+ * giving the start of the first of them and how many there are, however
+ * long the gap in the trace. A request arriving before the window at
+ * hand, as one without a timestamp does, is counted in it. */
+
+struct window {
+    unsigned long start; /* In microseconds. */
+    unsigned long reqs;
+    double reqbytes, dskbytes;
+    unsigned long methods[RRMETHOD + 1];
+};
+
+/* This function prints a window's line. len is the window length in
+ * microseconds. */
+static void printwindow(const struct window *w, unsigned long len)
+{
+    double secs;
+
+    secs = len / 1e6;
+
+    printf("%.6f %lu %.1f %.3f %.3f %lu %lu %lu %lu %lu %lu\n", w->start /
+      1e6, w->reqs, w->reqs / secs, w->reqbytes / 1e6 / secs, w->reqbytes ?
+      w->dskbytes / w->reqbytes : 0, w->methods[NWMETHOD],
+      w->methods[RMWMETHOD], w->methods[RWMETHOD], w->methods[RWPLUSMETHOD],
+      w->methods[DRMETHOD], w->methods[RRMETHOD]);
+}
+
+/* This function plans every job from the source and prints the time
+ * series, with windows len microseconds long. */
+void runseries(struct jobsrc *src, unsigned long len)
+{
+    unsigned sreqnum;
+    unsigned long start;
+    int first;
+    struct job jb;
+    struct ioplan plan;
+    struct window w;
+
+    memset(&w, 0, sizeof w);
+    first = 1;
+
+    initioplan(&plan);
+    plan.model = costmodel;
+
+    printf("# start reqs iops MB/s amp nw rmw rw rw+ dr rr\n");
+
+    while (src->next(src, &jb) == 0) {
+        if (planraidreq(&jb.array, &jb.req, &plan)) {
+            fprintf(stderr, "Could not plan the RAID request; "
+              "skipped.\n");
+            continue;
+        }
+
+        /* The series starts with the window of the first request. */
+        if (first) {
+            w.start = jb.req.time - jb.req.time % len;
+            first = 0;
+        }
+
+        if (jb.req.time >= w.start + len) {
+            printwindow(&w, len);
+            start = jb.req.time - jb.req.time % len;
+            if (start > w.start + len)
+                printf("# %.6f %lu empty\n", (w.start + len) / 1e6, (start
+                  - w.start - len) / len);
+            fflush(stdout);
+            memset(&w, 0, sizeof w);
+            w.start = start;
+        }
+
+        ++w.reqs;
+        if (jb.req.nature != DISCARDREQ) w.reqbytes += jb.req.len;
+        w.dskbytes += (double) plan.rdbytes + plan.wrbytes;
+        for (sreqnum = 0; sreqnum < plan.sreqcount; ++sreqnum)
+            ++w.methods[plan.sreqs[sreqnum].method];
+    }
+
+    if (w.reqs) printwindow(&w, len);
+
+    freeioplan(&plan);
+}
+
+/* vim: set cindent shiftwidth=4 expandtab: */
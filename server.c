@@ -0,0 +1,203 @@
+/* Sockets and file descriptors are POSIX matters. */
+#define _POSIX_C_SOURCE 200112L
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "simint.h"
+
+/* This file implements the simulator's query server. Rather than running
+ * the built-in jobs once, the server reads text request records (see
+ * textrec.c) from standard input or from clients of a Unix domain
+ * socket, and answers every record with one line. The array and the plan
+ * storage are kept from one request to the next, so a request costs
+ * little more than planning it. So are the cost model, the reconstructed-
+ * unit cache and the known-zero map, if asked for (see attachplan), and
+ * their totals are reported on standard error when a client is done.
+ *
+ * An array record is answered with "a". A request record is answered
+ * with
+ *
+ *     SREQS RDBYTES WRBYTES RDOPS WROPS NW RMW RW RW+ DR RR PARTIALS
+ *
+ * that is, the number of stripe requests, the bytes and disk operations
+ * the plan amounts to, how many stripe requests were given to each
+ * service method, and the partly written sectors read-modify-written.
+ * Anything the server cannot make sense of is answered with a line
+ * beginning with "?".
+ *
+ * Clients may pipeline: records are taken in as large batches as the
+ * input offers, and the answers to a batch go out in one write, without
+ * waiting for the client to read each one. */
+
+/* The plans are readied, and what they add up to reported, by the usual
+ * code in reqsim.c. */
+extern void attachplan(struct ioplan *plan);
+extern void detachplan(struct ioplan *plan);
+extern void addtotals(const struct job *jb, const struct ioplan *plan);
+extern void reporttotals();
+
+/* Sizes of the input and output buffers. A record must fit in INBUF. */
+#define INBUF 65536
+#define OUTBUF 65536
+
+/* Room an answer is guaranteed to have in the output buffer. */
+#define ANSWERMAX 160
+
+/* This function writes out the whole buffer. */
+static int writeall(int fd, const char *buf, unsigned len)
+{
+    ssize_t n;
+
+    while (len) {
+        if ((n = write(fd, buf, len)) <= 0) return -1;
+
+        buf += n;
+        len -= n;
+    }
+
+    return 0;
+}
+
+/* This function answers one record, placing the answer at ans. The
+ * length of the answer is returned. */
+static unsigned answer(char *line, struct job *jb, int *havearray, struct
+  ioplan *plan, char *ans)
+{
+    unsigned counts[RRMETHOD + 1], sreqnum;
+
+    switch (parserecord(line, jb)) {
+    case RECNONE:
+        return 0;
+
+    case RECARRAY:
+        *havearray = 1;
+        return sprintf(ans, "a\n");
+
+    case RECREQ:
+        if (!*havearray) return sprintf(ans, "? no array\n");
+
+        if (planraidreq(&jb->array, &jb->req, plan))
+            return sprintf(ans, "? cannot plan\n");
+        addtotals(jb, plan);
+
+        memset(counts, 0, sizeof counts);
+        for (sreqnum = 0; sreqnum < plan->sreqcount; ++sreqnum)
+            ++counts[plan->sreqs[sreqnum].method];
+
+        return sprintf(ans, "%u %u %u %u %u %u %u %u %u %u %u %u\n",
+          plan->sreqcount, plan->rdbytes, plan->wrbytes, plan->rdops,
+          plan->wrops, counts[NWMETHOD], counts[RMWMETHOD],
+          counts[RWMETHOD], counts[RWPLUSMETHOD], counts[DRMETHOD],
+          counts[RRMETHOD], plan->partials);
+
+    default:
+        return sprintf(ans, "? bad record\n");
+    }
+}
+
+/* This function serves one client until it closes its end. Records are
+ * read from infd, and answers are written to outfd. */
+static int serve(int infd, int outfd)
+{
+    static char in[INBUF], out[OUTBUF];
+    unsigned have, outlen;
+    char *line, *eol;
+    ssize_t n;
+    int havearray, status;
+    struct job jb;
+    struct ioplan plan;
+
+    have = outlen = 0;
+    havearray = 0;
+    status = 0;
+
+    initioplan(&plan);
+    attachplan(&plan);
+
+    while (status == 0 && (n = read(infd, in + have, INBUF - 1 - have)) >
+      0) {
+        have += n;
+        in[have] = '\0';
+
+        for (line = in; status == 0 && (eol = strchr(line, '\n')) != NULL;
+          line = eol + 1) {
+            *eol = '\0';
+
+            if (outlen > OUTBUF - ANSWERMAX) {
+                status = writeall(outfd, out, outlen);
+                outlen = 0;
+            }
+
+            outlen += answer(line, &jb, &havearray, &plan, out + outlen);
+        }
+
+        /* Keep the incomplete record, if any, for the next read. A line
+         * filling the whole buffer cannot be a record. */
+        have -= line - in;
+        memmove(in, line, have);
+
+        if (have == INBUF - 1) {
+            have = 0;
+            outlen += sprintf(out + outlen, "? record too long\n");
+        }
+
+        /* The batch is done. */
+        if (status == 0 && outlen) status = writeall(outfd, out, outlen);
+        outlen = 0;
+    }
+
+    if (n < 0) status = -1;
+
+    detachplan(&plan);
+    freeioplan(&plan);
+
+    reporttotals();
+
+    return status;
+}
+
+/* This function runs the server over standard input and output. */
+int servestdio()
+{
+    return serve(STDIN_FILENO, STDOUT_FILENO) ? 1 : 0;
+}
+
+/* This function runs the server on a Unix domain socket bound to path.
+ * Clients are served one after another, and the function only returns on
+ * failure. */
+int servesocket(const char *path)
+{
+    int client, sock;
+    struct sockaddr_un addr;
+
+    if (strlen(path) >= sizeof addr.sun_path) {
+        fprintf(stderr, "The socket path is too long.\n");
+        exit(9);
+    }
+
+    memset(&addr, 0, sizeof addr);
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+
+    unlink(path);
+
+    if ((sock = socket(AF_UNIX, SOCK_STREAM, 0)) < 0 || bind(sock, (struct
+      sockaddr *) &addr, sizeof addr) || listen(sock, 8)) {
+        fprintf(stderr, "Could not set up the socket %s.\n", path);
+        exit(10);
+    }
+
+    while ((client = accept(sock, NULL, NULL)) >= 0) {
+        serve(client, client);
+        close(client);
+    }
+
+    fprintf(stderr, "Could not accept a client.\n");
+    close(sock);
+
+    return 1;
+}
+
+/* vim: set cindent shiftwidth=4 expandtab: */
@@ -0,0 +1,69 @@
+#include "reqsim.h"
+
+/* Declarations shared among the simulator's own files, none of which is
+ * part of the library. Library users need only reqsim.h. */
+
+/* Packed sector bitmaps (secmap.c). Bit n of a map, counting from the
+ * least significant bit of the first word, stands for sector n. */
+#define SECMAPBITS (8 * sizeof (unsigned long))
+#define SECMAPWORDS(sectors) (((sectors) + SECMAPBITS - 1) / SECMAPBITS)
+
+void secmapclear(unsigned long *map, unsigned sectors);
+void secmapset(unsigned long *map, unsigned first, unsigned count);
+unsigned secmapcount(const unsigned long *map, unsigned words);
+void secmaprender(const unsigned long *map, unsigned first, unsigned
+  count, char *str);
+
+/* Outcome of parsing a text request record (textrec.c): no record, an
+ * array record, a request record, or a malformed line. */
+enum rectype {RECNONE, RECARRAY, RECREQ, RECBAD};
+
+enum rectype parserecord(const char *line, struct job *jb);
+
+/* Source of simulation jobs. next fills in the next job and returns 0,
+ * or returns nonzero when there are no more jobs. close gives back
+ * whatever the source holds, including the source itself. Particular
+ * sources extend this structure by embedding it as their first member. */
+struct jobsrc {
+    int (*next)(struct jobsrc *src, struct job *jb);
+    void (*close)(struct jobsrc *src);
+};
+
+struct jobsrc *opentextsrc(FILE *file);
+
+/* Binary traces (bintrace.c). openbinsrc returns NULL if the file cannot
+ * be opened or is not a binary trace. binsrclen gives the number of
+ * records in the trace, and binsrcseek limits the source to count
+ * records, starting with record first, counting from 0; sources over the
+ * same file are independent of one another. */
+struct jobsrc *openbinsrc(const char *path);
+unsigned long binsrclen(struct jobsrc *src);
+void binsrcseek(struct jobsrc *src, unsigned long first, unsigned long
+  count);
+
+/* The cost model chosen on the command line (reqsim.c), if any, and the
+ * most disks an array may have where the simulator keeps an account of
+ * every disk. */
+extern const struct devmodel *costmodel;
+
+#define MAXDISKS 64
+
+/* Time by disk (diskclock.c). A phase is the operations and bytes to be
+ * read, or written, on every disk. chargephase charges a phase to the
+ * disks of clock, each busy up to the time it holds, starting no earlier
+ * than at, and returns the time all of it is done. gatherphase gathers
+ * the reads (write == 0) or writes of a plan into a phase, and chargeplan
+ * charges the reads of a plan, then its writes. */
+struct dskphase {
+    unsigned long ops[MAXDISKS];
+    double bytes[MAXDISKS];
+};
+
+double chargephase(const struct devmodel *model, double *clock, unsigned
+  dsks, const struct dskphase *ph, double at);
+void gatherphase(struct dskphase *ph, const struct ioplan *plan, unsigned
+  dsks, int write);
+double chargeplan(const struct devmodel *model, double *clock, unsigned
+  dsks, const struct ioplan *plan, double at);
+
+/* vim: set cindent shiftwidth=4 expandtab: */
@@ -0,0 +1,439 @@
+#include "simint.h"
+
+/* This file simulates the stripe locks which keep parity consistent when
+ * many requests are in flight at once. Every stripe request that writes,
+ * and every reconstruct-read, which depends on parity matching the data,
+ * holds the lock of its stripe from the time it starts until it is done;
+ * a lock covers granularity stripes, so that coarser locks can be tried.
+ * Stripe requests wait for the lock first come, first served, and reads
+ * served directly take no lock. The stripe requests of a RAID request run
+ * at once, each taking its own lock.
+ *
+ * Requests arrive at their times, in time order, and the operations of
+ * stripe requests are timed by disktime (libreqsim.c) under the cost
+ * model, hddmodel unless another is chosen. A stripe request waiting for
+ * a lock is timed when it arrives, from the time it will start, so every
+ * disk keeps the spans of time it is busy rather than a single clock: an
+ * operation takes the first idle gap long enough for it, and the gaps
+ * before a waiting stripe request remain for those arriving after it.
+ *
+ * With merging, a write stripe request which finds the last holder of the
+ * lock still waiting, and writing the same stripe, joins it if the parity
+ * it reads and writes lies within what the holder reads and writes: their
+ * parity is updated once, for both, so the joining stripe request reads
+ * and writes only its data, and the lock is held until both are done.
+ *
+ * The report gives the lock waits and the queues found waiting for the
+ * lock on arrival, the latency of the requests, the parity updates merging
+ * avoided, and the HOTLOCKS locks waited for longest. */
+
+#define HOTLOCKS 10
+
+static const struct devmodel *model;
+
+/* The spans of time a disk is busy, in time order, none overlapping or
+ * touching another. */
+struct span {
+    double start, end;
+};
+
+static struct {
+    struct span *spans;
+    unsigned count, cap;
+} disks[MAXDISKS];
+
+/* A lock, with the times the stripe requests holding it and waiting for
+ * it will be done, as a ring, oldest first. */
+struct lock {
+    unsigned long id;
+    struct lock *nextinbucket;
+    double *ends;
+    unsigned head, queued, cap;
+    /* The last stripe request to take the lock: its stripe, whether it
+     * writes, when it starts, and the parity it reads and writes. */
+    unsigned stripe;
+    int write;
+    double start;
+    struct unitscope prd, pwr;
+    /* Stripe requests that took the lock, that waited, and joined
+     * another; the time waited; the longest queue found. */
+    unsigned long holds, waits, merged;
+    double waited;
+    unsigned maxqueue;
+};
+
+/* Locks, hashed by id. */
+static struct lock **buckets;
+static unsigned long bucketcount, lockcount;
+
+static void nomemory()
+{
+    fprintf(stderr, "Could not get memory for the stripe locks.\n");
+    exit(52);
+}
+
+/* This function puts an operation taking len seconds on a disk in the
+ * first idle gap that begins no earlier than at and fits it. The time it
+ * is done is returned. */
+static double occupy(unsigned disk, double at, double len)
+{
+    unsigned i;
+    struct span *mem, *sp;
+
+    sp = disks[disk].spans;
+
+    for (i = 0; i < disks[disk].count && sp[i].start < at + len; ++i)
+        if (sp[i].end > at) at = sp[i].end;
+
+    /* The operation goes between spans i - 1 and i, joining them where it
+     * touches them. */
+    if (i && sp[i - 1].end == at) {
+        sp[i - 1].end = at + len;
+        if (i < disks[disk].count && sp[i].start == at + len) {
+            sp[i - 1].end = sp[i].end;
+            memmove(sp + i, sp + i + 1, (disks[disk].count - i - 1) * sizeof
+              *sp);
+            --disks[disk].count;
+        }
+    }
+    else if (i < disks[disk].count && sp[i].start == at + len)
+        sp[i].start = at;
+    else {
+        if (disks[disk].count == disks[disk].cap) {
+            if ((mem = (struct span *) realloc((void *) sp,
+              (disks[disk].cap ? 2 * disks[disk].cap : 16) * sizeof *sp))
+              == NULL)
+                nomemory();
+            disks[disk].spans = sp = mem;
+            disks[disk].cap = disks[disk].cap ? 2 * disks[disk].cap : 16;
+        }
+        memmove(sp + i + 1, sp + i, (disks[disk].count - i) * sizeof *sp);
+        sp[i].start = at;
+        sp[i].end = at + len;
+        ++disks[disk].count;
+    }
+
+    return at + len;
+}
+
+/* This function forgets the spans a disk is done with by time at, which
+ * no request arriving from then on can fall into. */
+static void forget(unsigned disk, double at)
+{
+    unsigned i;
+
+    for (i = 0; i < disks[disk].count && disks[disk].spans[i].end <= at;
+      ++i);
+
+    if (i) {
+        memmove(disks[disk].spans, disks[disk].spans + i,
+          (disks[disk].count - i) * sizeof *disks[disk].spans);
+        disks[disk].count -= i;
+    }
+}
+
+/* This function returns the lock of the given id, making it if need be. */
+static struct lock *findlock(unsigned long id)
+{
+    unsigned long i;
+    struct lock *lk, *next, **old;
+
+    for (lk = buckets[id % bucketcount]; lk; lk = lk->nextinbucket)
+        if (lk->id == id) return lk;
+
+    /* The table is doubled once it holds as many locks as buckets. */
+    if (lockcount == bucketcount) {
+        old = buckets;
+        if ((buckets = (struct lock **) calloc(2 * bucketcount, sizeof
+          *buckets)) == NULL)
+            nomemory();
+        for (i = 0; i < bucketcount; ++i)
+            for (lk = old[i]; lk; lk = next) {
+                next = lk->nextinbucket;
+                lk->nextinbucket = buckets[lk->id % (2 * bucketcount)];
+                buckets[lk->id % (2 * bucketcount)] = lk;
+            }
+        bucketcount *= 2;
+        free((void *) old);
+    }
+
+    if ((lk = (struct lock *) calloc(1, sizeof *lk)) == NULL) nomemory();
+    lk->id = id;
+    lk->nextinbucket = buckets[id % bucketcount];
+    buckets[id % bucketcount] = lk;
+    ++lockcount;
+
+    return lk;
+}
+
+/* This function adds the time a stripe request holding the lock will be
+ * done to the end of the queue. */
+static void enqueue(struct lock *lk, double end)
+{
+    unsigned i;
+    double *ends;
+
+    if (lk->queued == lk->cap) {
+        if ((ends = (double *) malloc((lk->cap ? 2 * lk->cap : 4) * sizeof
+          *ends)) == NULL)
+            nomemory();
+        for (i = 0; i < lk->queued; ++i)
+            ends[i] = lk->ends[(lk->head + i) % lk->cap];
+        free((void *) lk->ends);
+        lk->ends = ends;
+        lk->head = 0;
+        lk->cap = lk->cap ? 2 * lk->cap : 4;
+    }
+
+    lk->ends[(lk->head + lk->queued++) % lk->cap] = end;
+}
+
+/* This function returns the disk holding the parity of a stripe. */
+static unsigned paritydisk(const struct dskarray *array, unsigned stripe)
+{
+    return (array->lvl == RAID4) ? array->datadsks : array->datadsks -
+      stripe % (array->datadsks + 1);
+}
+
+/* This function tells whether scope inner lies within scope outer. */
+static int within(const struct unitscope *inner, const struct unitscope
+  *outer)
+{
+    return inner->len == 0 || outer->len && inner->offset >= outer->offset
+      && inner->offset + inner->len <= outer->offset + outer->len;
+}
+
+/* This function times a stripe request on the disks, starting no earlier
+ * than at, leaving out the parity disk if skip is nonzero. Its writes
+ * start once its reads are done. The time it is done is returned. */
+static double timesreq(const struct dskarray *array, const struct
+  stripeplan *sp, double at, int skip)
+{
+    unsigned disk, i, parity;
+    double end, phaseend;
+    const struct unitscope *scope;
+
+    parity = paritydisk(array, sp->stripe);
+
+    for (i = 0; i < 2; ++i) {
+        phaseend = at;
+
+        for (disk = 0; disk <= array->datadsks; ++disk) {
+            scope = i ? &sp->wr[disk] : &sp->rd[disk];
+            if (scope->len == 0 || skip && disk == parity) continue;
+
+            end = occupy(disk, at, disktime(model, 1, scope->len));
+            if (end > phaseend) phaseend = end;
+        }
+
+        at = phaseend;
+    }
+
+    return at;
+}
+
+/* This function orders locks by time waited, longest first. */
+static int bywaited(const void *a, const void *b)
+{
+    const struct lock *la = *(const struct lock **) a;
+    const struct lock *lb = *(const struct lock **) b;
+
+    return (la->waited < lb->waited) - (la->waited > lb->waited);
+}
+
+/* This function prints the report. */
+static void report(unsigned long reqs, double latency, unsigned long
+  sreqs, double queues, double paritybytes, unsigned granularity, int
+  merge)
+{
+    unsigned long holds, i, merged, n, waits;
+    unsigned maxqueue;
+    double waited;
+    struct lock *lk, **locks;
+
+    holds = merged = waits = 0;
+    maxqueue = 0;
+    waited = 0;
+
+    if ((locks = (struct lock **) malloc((lockcount ? lockcount : 1) *
+      sizeof *locks)) == NULL)
+        nomemory();
+
+    for (n = i = 0; i < bucketcount; ++i)
+        for (lk = buckets[i]; lk; lk = lk->nextinbucket) {
+            locks[n++] = lk;
+            holds += lk->holds;
+            waits += lk->waits;
+            merged += lk->merged;
+            waited += lk->waited;
+            if (lk->maxqueue > maxqueue) maxqueue = lk->maxqueue;
+        }
+
+    printf("%lu requests, %lu stripe requests, %lu of them locking "
+      "%lu locks of %u stripes:\n", reqs, sreqs, holds, lockcount,
+      granularity);
+    printf("  %lu waited for the lock, %.6f s in all, %.6f s on "
+      "average\n", waits, waited, holds ? waited / holds : 0);
+    printf("  queue found on arrival: %.3f on average, %u at most\n",
+      holds ? queues / holds : 0, maxqueue);
+    printf("  request latency: %.6f s on average\n", reqs ? latency / reqs
+      : 0);
+    if (merge)
+        printf("  %lu parity updates avoided by merging, %.3f MB of "
+          "parity not read or written\n", merged, paritybytes / 1e6);
+
+    qsort(locks, n, sizeof *locks, bywaited);
+
+    printf("\n%-12s %10s %10s %10s %12s %9s\n", "lock", "holds", "waits",
+      "merged", "waited s", "max queue");
+    for (i = 0; i < n && i < HOTLOCKS && locks[i]->waited > 0; ++i)
+        printf("%-12lu %10lu %10lu %10lu %12.6f %9u\n", locks[i]->id,
+          locks[i]->holds, locks[i]->waits, locks[i]->merged,
+          locks[i]->waited, locks[i]->maxqueue);
+
+    free((void *) locks);
+}
+
+/* This function plans every job from the source and runs the stripe
+ * requests under locks of granularity stripes each, merging parity
+ * updates if merge is nonzero, then prints the report. */
+void runstripelocks(struct jobsrc *src, unsigned granularity, int merge)
+{
+    unsigned disk, parity;
+    unsigned long i, reqs, sreqs;
+    double at, done, end, latency, paritybytes, queues, start;
+    int havearray;
+    struct dskarray array;
+    struct job jb;
+    struct ioplan plan;
+    struct lock *lk, *next;
+    struct stripeplan *sp;
+
+    model = costmodel ? costmodel : &hddmodel;
+
+    bucketcount = 1024;
+    lockcount = 0;
+    if ((buckets = (struct lock **) calloc(bucketcount, sizeof *buckets))
+      == NULL)
+        nomemory();
+
+    initioplan(&plan);
+    plan.model = costmodel;
+
+    havearray = 0;
+    reqs = sreqs = 0;
+    latency = paritybytes = queues = 0;
+
+    while (src->next(src, &jb) == 0) {
+        if (!havearray) {
+            if (jb.array.datadsks + 1 > MAXDISKS) {
+                fprintf(stderr, "Too many disks to lock the stripes "
+                  "of.\n");
+                exit(53);
+            }
+            array = jb.array;
+            havearray = 1;
+        }
+        else if (memcmp(&jb.array, &array, sizeof array)) {
+            fprintf(stderr, "Stripe locks are simulated against a single "
+              "array.\n");
+            exit(54);
+        }
+
+        if (planraidreq(&jb.array, &jb.req, &plan)) {
+            fprintf(stderr, "Could not plan the RAID request; "
+              "skipped.\n");
+            continue;
+        }
+
+        at = jb.req.time / 1e6;
+        done = at;
+
+        for (disk = 0; disk <= array.datadsks; ++disk) forget(disk, at);
+
+        for (sp = plan.sreqs; sp < plan.sreqs + plan.sreqcount; ++sp) {
+            if (sp->wrops == 0 && sp->method != RRMETHOD) {
+                if ((end = timesreq(&array, sp, at, 0)) > done)
+                    done = end;
+                continue;
+            }
+
+            lk = findlock(sp->stripe / granularity);
+
+            /* The holders done by the time this one arrives. */
+            while (lk->queued && lk->ends[lk->head] <= at) {
+                lk->head = (lk->head + 1) % lk->cap;
+                --lk->queued;
+            }
+
+            ++lk->holds;
+            queues += lk->queued;
+            if (lk->queued > lk->maxqueue) lk->maxqueue = lk->queued;
+
+            parity = paritydisk(&array, sp->stripe);
+
+            if (merge && sp->wrops && lk->queued && lk->write &&
+              lk->stripe == sp->stripe && lk->start > at &&
+              within(&sp->rd[parity], &lk->prd) && within(&sp->wr[parity],
+              &lk->pwr)) {
+                /* Join the last holder, which has yet to start. */
+                end = timesreq(&array, sp, lk->start, 1);
+                i = (lk->head + lk->queued - 1) % lk->cap;
+                if (end > lk->ends[i]) lk->ends[i] = end;
+                end = lk->ends[i];
+
+                ++lk->merged;
+                ++lk->waits;
+                lk->waited += lk->start - at;
+                paritybytes += (double) sp->rd[parity].len +
+                  sp->wr[parity].len;
+            }
+            else {
+                start = lk->queued ? lk->ends[(lk->head + lk->queued - 1)
+                  % lk->cap] : at;
+                if (start < at) start = at;
+                if (start > at) {
+                    ++lk->waits;
+                    lk->waited += start - at;
+                }
+
+                end = timesreq(&array, sp, start, 0);
+                enqueue(lk, end);
+
+                lk->stripe = sp->stripe;
+                lk->write = sp->wrops != 0;
+                lk->start = start;
+                lk->prd = sp->rd[parity];
+                lk->pwr = sp->wr[parity];
+            }
+
+            if (end > done) done = end;
+        }
+
+        ++reqs;
+        sreqs += plan.sreqcount;
+        latency += done - at;
+    }
+
+    freeioplan(&plan);
+
+    if (havearray)
+        report(reqs, latency, sreqs, queues, paritybytes, granularity,
+          merge);
+
+    for (i = 0; i < bucketcount; ++i)
+        for (lk = buckets[i]; lk; lk = next) {
+            next = lk->nextinbucket;
+            free((void *) lk->ends);
+            free((void *) lk);
+        }
+    free((void *) buckets);
+
+    for (disk = 0; disk < MAXDISKS; ++disk) {
+        free((void *) disks[disk].spans);
+        disks[disk].spans = NULL;
+        disks[disk].count = disks[disk].cap = 0;
+    }
+}
+
+/* vim: set cindent shiftwidth=4 expandtab: */
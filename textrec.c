@@ -0,0 +1,188 @@
+#include <errno.h>
+#include <limits.h>
+
+#include "simint.h"
+
+/* This file reads text request records, the simplest way of feeding jobs
+ * to the simulator from outside. There is one record per line, and fields
+ * are separated by blanks. An array record describes the disk array that
+ * the request records following it are made against:
+ *
+ *     a LEVEL DATADSKS STRIPINGUNIT FLTSTATA [SECTOR]
+ *
+ * LEVEL is 4 or 5, STRIPINGUNIT is in bytes, and FLTSTATA is the number
+ * of the faulty disk, or -1 for a fault-free array. SECTOR is the sector
+ * size in bytes, SECTOR (reqsim.h) if left out. A request record is
+ *
+ *     r OFFSET LENGTH [TIME]
+ *     w OFFSET LENGTH [TIME]
+ *     d OFFSET LENGTH [TIME]
+ *
+ * for a read, a write or a discard, respectively, with OFFSET and LENGTH
+ * in bytes. TIME is when the request arrives, in microseconds from the
+ * start of the trace, 0 if left out. Empty lines and lines beginning with
+ * # carry no record, and a record may be followed by a # comment, but by
+ * nothing else. */
+
+/* This function skips blanks and reads one unsigned number no greater
+ * than max, advancing *str past it. -1 is returned if there is no number,
+ * and 1 if it is greater than max. */
+static int getnum(const char **str, unsigned long *num, unsigned long max)
+{
+    char *end;
+
+    errno = 0;
+    *num = strtoul(*str, &end, 10);
+    if (end == *str) return -1;
+
+    *str = end;
+
+    return (errno == ERANGE || *num > max) ? 1 : 0;
+}
+
+/* This function tells whether nothing but blanks and maybe a comment is
+ * left of a line. */
+static int atend(const char *str)
+{
+    while (*str == ' ' || *str == '\t') ++str;
+
+    return *str == '\0' || *str == '\n' || *str == '\r' || *str == '#';
+}
+
+/* This function parses one line into the job. An array record updates
+ * jb->array, and a request record updates jb->req; the other half of the
+ * job is left alone. */
+enum rectype parserecord(const char *line, struct job *jb)
+{
+    unsigned long lvl, datadsks, stripingunit, offset, len, sector, time;
+    const char *p;
+    int neg, status, type;
+
+    for (p = line; *p == ' ' || *p == '\t'; ++p);
+
+    switch (type = *p++) {
+    case '\0': case '\n': case '\r': case '#':
+        return RECNONE;
+
+    case 'a':
+        if (getnum(&p, &lvl, UINT_MAX) || getnum(&p, &datadsks, UINT_MAX)
+          || getnum(&p, &stripingunit, UINT_MAX) || lvl != 4 && lvl != 5)
+            return RECBAD;
+
+        /* The faulty disk, or -1 and nothing else for none. */
+        while (*p == ' ' || *p == '\t') ++p;
+        if ((neg = *p == '-') != 0) ++p;
+        if (getnum(&p, &offset, INT_MAX) || neg && offset != 1)
+            return RECBAD;
+        if ((status = getnum(&p, &sector, UINT_MAX)) > 0) return RECBAD;
+        if (status) sector = 0;
+        if (!atend(p)) return RECBAD;
+
+        jb->array.lvl = (lvl == 4) ? RAID4 : RAID5;
+        jb->array.datadsks = datadsks;
+        jb->array.stripingunit = stripingunit;
+        jb->array.fltstata = neg ? FLTFREE : (int) offset;
+        jb->array.sector = sector;
+
+        return RECARRAY;
+
+    case 'r': case 'w': case 'd':
+        if (getnum(&p, &offset, UINT_MAX) || getnum(&p, &len, UINT_MAX))
+            return RECBAD;
+        if ((status = getnum(&p, &time, ULONG_MAX)) > 0) return RECBAD;
+        if (status) time = 0;
+        if (!atend(p)) return RECBAD;
+
+        jb->req.nature = (type == 'r') ? READREQ : (type == 'w') ?
+          WRITEREQ : DISCARDREQ;
+        jb->req.offset = offset;
+        jb->req.len = len;
+        jb->req.time = time;
+
+        return RECREQ;
+
+    default:
+        return RECBAD;
+    }
+}
+
+/* A job source reading text records from a file. */
+struct textsrc {
+    struct jobsrc src;
+    FILE *file;
+    struct job jb;     /* The array in force, and the last request. */
+    int havearray;
+    unsigned long line; /* Line number, for complaints. */
+};
+
+/* Longest line taken for a record. */
+#define LINEMAX 256
+
+static int nexttextjob(struct jobsrc *src, struct job *jb)
+{
+    struct textsrc *ts = (struct textsrc *) src;
+    char line[LINEMAX];
+    int c;
+
+    while (fgets(line, sizeof line, ts->file) != NULL) {
+        ++ts->line;
+
+        if (strchr(line, '\n') == NULL && !feof(ts->file)) {
+            while ((c = getc(ts->file)) != EOF && c != '\n');
+            fprintf(stderr, "Line %lu: too long; skipped.\n", ts->line);
+            continue;
+        }
+
+        switch (parserecord(line, &ts->jb)) {
+        case RECARRAY:
+            ts->havearray = 1;
+            break;
+
+        case RECREQ:
+            if (ts->havearray) {
+                *jb = ts->jb;
+                return 0;
+            }
+            fprintf(stderr, "Line %lu: request before any array; "
+              "skipped.\n", ts->line);
+            break;
+
+        case RECBAD:
+            fprintf(stderr, "Line %lu: bad record; skipped.\n",
+              ts->line);
+            break;
+
+        default:
+            break;
+        }
+    }
+
+    return -1;
+}
+
+static void closetextsrc(struct jobsrc *src)
+{
+    free((void *) src);
+}
+
+/* This function makes a job source out of a file of text records. The
+ * file stays open when the source is closed. */
+struct jobsrc *opentextsrc(FILE *file)
+{
+    struct textsrc *ts;
+
+    if ((ts = (struct textsrc *) malloc(sizeof *ts)) == NULL) {
+        fprintf(stderr, "Could not get memory for a job source.\n");
+        exit(12);
+    }
+
+    ts->src.next = nexttextjob;
+    ts->src.close = closetextsrc;
+    ts->file = file;
+    ts->havearray = 0;
+    ts->line = 0;
+
+    return &ts->src;
+}
+
+/* vim: set cindent shiftwidth=4 expandtab: */
@@ -0,0 +1,59 @@
+#include "reqsim.h"
+
+/* This file hosts the XOR kernel parity is computed with. Like the
+ * bitmaps in secmap.c, it comes in AVX2 and SSE2 flavours next to a plain
+ * C one, picked at compile time (see SIMDFLAGS in the Makefile). */
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define FLAVOUR "AVX2"
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define FLAVOUR "SSE2"
+#else
+#define FLAVOUR "C"
+#endif
+
+const char xorflavour[] = FLAVOUR;
+
+/* This function XORs len bytes of src into dst. */
+void xorblock(unsigned char *dst, const unsigned char *src, unsigned len)
+{
+    unsigned i;
+
+    i = 0;
+
+#if defined(__AVX2__)
+    for (; i + 64 <= len; i += 64) {
+        _mm256_storeu_si256((__m256i *) (dst + i), _mm256_xor_si256(
+          _mm256_loadu_si256((const __m256i *) (dst + i)),
+          _mm256_loadu_si256((const __m256i *) (src + i))));
+        _mm256_storeu_si256((__m256i *) (dst + i + 32), _mm256_xor_si256(
+          _mm256_loadu_si256((const __m256i *) (dst + i + 32)),
+          _mm256_loadu_si256((const __m256i *) (src + i + 32))));
+    }
+#elif defined(__SSE2__)
+    for (; i + 32 <= len; i += 32) {
+        _mm_storeu_si128((__m128i *) (dst + i), _mm_xor_si128(
+          _mm_loadu_si128((const __m128i *) (dst + i)),
+          _mm_loadu_si128((const __m128i *) (src + i))));
+        _mm_storeu_si128((__m128i *) (dst + i + 16), _mm_xor_si128(
+          _mm_loadu_si128((const __m128i *) (dst + i + 16)),
+          _mm_loadu_si128((const __m128i *) (src + i + 16))));
+    }
+#endif
+
+    for (; i + sizeof (unsigned long) <= len; i += sizeof (unsigned long))
+    {
+        unsigned long d, s;
+
+        memcpy(&d, dst + i, sizeof d);
+        memcpy(&s, src + i, sizeof s);
+        d ^= s;
+        memcpy(dst + i, &d, sizeof d);
+    }
+
+    for (; i < len; ++i) dst[i] ^= src[i];
+}
+
+/* vim: set cindent shiftwidth=4 expandtab: */